@@ -0,0 +1,135 @@
+// Compares the request body parsers on the bodies the API actually receives.
+// Each case parses the body and reads the fields its handler reads through
+// util::JsonView, the way BaseHandler and ApiHandler do.
+//
+// Build with -DSECURAPP_BUILD_BENCHMARKS=ON and run ./json_parse_bench
+// [iterations]. The simdjson rows appear when simdjson was found.
+
+#include "util/Arena.h"
+#include "util/JsonView.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace securapp;
+
+namespace {
+
+struct Payload {
+    const char* name;
+    std::string body;
+    // Members the handler reads from it
+    std::vector<const char*> fields;
+};
+
+std::vector<Payload> payloads() {
+    std::vector<Payload> result;
+
+    // POST /api/auth
+    result.push_back({"auth", R"({"username":"alice","password":"correct horse battery staple"})",
+                      {"username", "password"}});
+
+    // POST /api/users
+    result.push_back({"create user",
+                      R"({"username":"alice","email":"alice@example.com",)"
+                      R"("password":"correct horse battery staple","full_name":"Alice Example"})",
+                      {"username", "email", "password", "full_name"}});
+
+    // POST /api/users from a client that sends its whole profile form; the
+    // handler still reads four members
+    std::string profile = R"({"username":"alice","email":"alice@example.com",)"
+                          R"("password":"correct horse battery staple","full_name":"Alice Example",)"
+                          R"("preferences":{"theme":"dark","language":"en-GB","notifications":[)";
+    for (int i = 0; i < 64; i++) {
+        profile += (i ? "," : "");
+        profile += R"({"channel":"email","topic":"topic-)" + std::to_string(i) +
+                   R"(","enabled":true,"weight":)" + std::to_string(i * 0.25) + "}";
+    }
+    profile += "]}}";
+    result.push_back({"create user (large)", profile,
+                      {"username", "email", "password", "full_name"}});
+
+    return result;
+}
+
+// Keeps the compiler from dropping the work
+volatile size_t sink;
+
+size_t readFields(const util::JsonView& view, const Payload& payload) {
+    size_t total = 0;
+    for (const char* field : payload.fields) {
+        total += view.getString(field).value_or("").size();
+    }
+    return total;
+}
+
+// nlohmann into the request arena, as the default json_parser does
+size_t parseNlohmann(const Payload& payload, util::Arena& arena) {
+    size_t total;
+    {
+        util::Arena::Scope scope(arena);
+        auto value = util::ArenaJson::parse(payload.body.begin(), payload.body.end());
+        total = readFields(util::JsonView(&value), payload);
+    }
+    arena.reset();
+    return total;
+}
+
+#ifdef SECURAPP_HAVE_SIMDJSON
+size_t parseSimd(const Payload& payload, const std::string& padded) {
+    util::JsonView view;
+    std::string error;
+    if (!util::parseSimdJson(reinterpret_cast<const uint8_t*>(padded.data()),
+                             payload.body.size(), view, error)) {
+        std::fprintf(stderr, "simdjson: %s\n", error.c_str());
+        std::exit(1);
+    }
+    return readFields(view, payload);
+}
+#endif
+
+template <typename F>
+void run(const char* parser, const Payload& payload, size_t iterations, F&& parse) {
+    // Warm up buffers and caches before timing
+    for (size_t i = 0; i < iterations / 10 + 1; i++) {
+        sink = parse();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sink = parse();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double nsPerOp = seconds * 1e9 / static_cast<double>(iterations);
+    double mbPerSec = static_cast<double>(payload.body.size()) * static_cast<double>(iterations) /
+                      seconds / 1e6;
+    std::printf("%-22s %-10s %8zu B %10.1f ns/op %9.1f MB/s\n",
+                payload.name, parser, payload.body.size(), nsPerOp, mbPerSec);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    util::Arena arena;
+    for (const Payload& payload : payloads()) {
+        run("nlohmann", payload, iterations, [&] { return parseNlohmann(payload, arena); });
+
+#ifdef SECURAPP_HAVE_SIMDJSON
+        // BaseHandler::bodyBytes() leaves this padding behind the body
+        std::string padded = payload.body;
+        padded.append(simdjson::SIMDJSON_PADDING, '\0');
+        run("simdjson", payload, iterations, [&] { return parseSimd(payload, padded); });
+#endif
+    }
+    return 0;
+}
@@ -74,6 +74,21 @@ BEFORE UPDATE ON users
 FOR EACH ROW
 EXECUTE FUNCTION update_timestamp();
 
+-- Tell the server's result cache which table changed (channel table_changes,
+-- payload the table name); delivered when the transaction commits
+CREATE OR REPLACE FUNCTION notify_table_change()
+RETURNS TRIGGER AS $$
+BEGIN
+    PERFORM pg_notify('table_changes', TG_TABLE_NAME);
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER notify_users_change
+AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON users
+FOR EACH STATEMENT
+EXECUTE FUNCTION notify_table_change();
+
 -- Create a sample admin user (password: admin123)
 -- The password_hash would normally be a bcrypt hash
 INSERT INTO users (username, email, password_hash, full_name, is_admin)
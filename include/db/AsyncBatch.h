@@ -0,0 +1,47 @@
+#pragma once
+
+#include "db/AsyncOperation.h"
+#include "db/QueryBatch.h"
+
+#include <memory>
+#include <vector>
+#include <folly/futures/Future.h>
+#include <folly/futures/Promise.h>
+
+namespace securapp {
+namespace db {
+
+// A QueryBatch pipelined over a connection without blocking the EventBase.
+// The object owns itself and is deleted once the sync point is reached.
+class AsyncBatch : public AsyncOperation {
+public:
+    // Send the batch on 'conn' and complete with one result per statement.
+    // Must be called on the EventBase thread. Fails with DatabaseError only
+    // when the connection itself fails; statement errors are reported in
+    // the individual BatchResults.
+    static folly::SemiFuture<std::vector<BatchResult>> start(
+        folly::EventBase* evb,
+        PooledConnection conn,
+        QueryBatch batch,
+        std::vector<std::shared_ptr<const PreparedStatement>> statements);
+
+private:
+    AsyncBatch(folly::EventBase* evb,
+               PooledConnection conn,
+               QueryBatch batch,
+               std::vector<std::shared_ptr<const PreparedStatement>> statements);
+    ~AsyncBatch() override = default;
+
+    // AsyncOperation
+    bool onResult(ResultPtr result) override;
+    void onError(const std::string& message) override;
+
+    folly::Promise<std::vector<BatchResult>> promise_;
+
+    // The run refers to the batch, so the batch is declared first
+    QueryBatch batch_;
+    PipelineRun run_;
+};
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "db/ConnectionPool.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <folly/futures/Future.h>
+#include <folly/futures/Promise.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+namespace securapp {
+namespace db {
+
+// Opens or re-opens a connection with libpq's non-blocking connect API
+// (PQconnectStart/PQconnectPoll, PQresetStart/PQresetPoll), polling the
+// socket on the EventBase so the TCP, TLS and authentication handshakes
+// never block the loop. Host names are still resolved inside libpq; set
+// hostaddr in the connection string to avoid that lookup. The object owns
+// itself and is deleted once the connection is up or has failed.
+class AsyncConnect : private folly::EventHandler {
+public:
+    // Open a new connection. Must be called on the EventBase thread. Fails
+    // with DatabaseError if the server cannot be reached within 'timeout'.
+    static folly::SemiFuture<std::unique_ptr<PgConnection>> open(
+        folly::EventBase* evb,
+        const std::string& connStr,
+        std::chrono::milliseconds timeout);
+
+    // Re-establish a broken connection; its prepared statements are lost
+    // and will be prepared again on first use
+    static folly::SemiFuture<std::unique_ptr<PgConnection>> reset(
+        folly::EventBase* evb,
+        std::unique_ptr<PgConnection> conn,
+        std::chrono::milliseconds timeout);
+
+    AsyncConnect(const AsyncConnect&) = delete;
+    AsyncConnect& operator=(const AsyncConnect&) = delete;
+
+private:
+    AsyncConnect(folly::EventBase* evb,
+                 std::unique_ptr<PgConnection> conn,
+                 bool resetting,
+                 std::chrono::milliseconds timeout);
+    ~AsyncConnect() override = default;
+
+    // EventHandler: the socket is ready for the next handshake step
+    void handlerReady(uint16_t events) noexcept override;
+
+    // Act on the latest poll status: wait for the socket or complete
+    void advance(PostgresPollingStatusType status);
+
+    // Deliver the outcome and destroy this object
+    void succeed();
+    void fail(const std::string& message);
+
+    folly::Promise<std::unique_ptr<PgConnection>> promise_;
+    std::unique_ptr<PgConnection> conn_;
+    std::unique_ptr<folly::AsyncTimeout> timeout_;
+    const bool resetting_;
+    // Socket being watched; libpq may switch sockets between attempts
+    int socket_ = -1;
+};
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "db/ConnectionPool.h"
+#include "db/PgResult.h"
+
+#include <string>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+namespace securapp {
+namespace db {
+
+// Base for database work driven by libpq's non-blocking API. The connection
+// socket is registered with the EventBase, so waiting for the server never
+// blocks the loop. Subclasses queue commands, receive results through
+// onResult() and own their lifetime (they delete themselves when done).
+// All methods run on the EventBase thread.
+class AsyncOperation : private folly::EventHandler {
+public:
+    AsyncOperation(const AsyncOperation&) = delete;
+    AsyncOperation& operator=(const AsyncOperation&) = delete;
+
+protected:
+    AsyncOperation(folly::EventBase* evb, PooledConnection conn);
+    ~AsyncOperation() override = default;
+
+    // Switch the connection to non-blocking mode before sending commands
+    bool enterNonBlocking();
+
+    // Flush queued output and (re)arm the socket. On failure onError() has
+    // been called and the object may be gone.
+    bool flush();
+
+    // Stop watching the socket and hand the connection back to the pool
+    void releaseConnection();
+
+    // Stop reading from the server while the consumer catches up. Results
+    // already buffered by libpq stay there; the server blocks on a full
+    // socket buffer instead of us growing memory.
+    void pauseReading();
+
+    // Undo pauseReading() and deliver anything buffered in the meantime.
+    // The operation may complete (and be deleted) before this returns.
+    void resumeReading();
+
+    bool readingPaused() const { return paused_; }
+
+    // Called in order for every result libpq has fully received; nullptr
+    // marks the end of a command's results. Return false once the operation
+    // has completed, after which the object must not be touched. After a
+    // nullptr the subclass must either send a new command or complete.
+    virtual bool onResult(ResultPtr result) = 0;
+
+    // The connection failed; implementations complete and delete themselves
+    virtual void onError(const std::string& message) = 0;
+
+    PooledConnection conn_;
+
+private:
+    // EventHandler: the connection socket became readable/writable
+    void handlerReady(uint16_t events) noexcept override;
+
+    // Re-register for the events we currently need
+    bool arm();
+
+    // Hand every fully received result to onResult()
+    void drainResults();
+
+    bool wantWrite_ = false;
+    bool paused_ = false;
+};
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "db/AsyncOperation.h"
+#include "db/PreparedStatement.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <folly/futures/Future.h>
+#include <folly/futures/Promise.h>
+
+namespace securapp {
+namespace db {
+
+// A single query run without blocking the EventBase. The object owns itself
+// and is deleted once the result is in.
+class AsyncQuery : public AsyncOperation {
+public:
+    // Send the query on 'conn' and complete with its result. Must be called
+    // on the EventBase thread. Fails with DatabaseError if the query fails
+    // or (with expectTuples) does not return rows.
+    static folly::SemiFuture<ResultPtr> start(
+        folly::EventBase* evb,
+        PooledConnection conn,
+        const std::string& query,
+        std::vector<std::string> params,
+        bool expectTuples);
+
+    // Same for a registered statement; it is prepared on the connection
+    // first if this session has not seen it yet
+    static folly::SemiFuture<ResultPtr> start(
+        folly::EventBase* evb,
+        PooledConnection conn,
+        std::shared_ptr<const PreparedStatement> statement,
+        std::vector<std::string> params,
+        bool expectTuples);
+
+private:
+    // Which command is in flight on the connection
+    enum class Phase { Preparing, Executing };
+
+    AsyncQuery(folly::EventBase* evb,
+               PooledConnection conn,
+               std::vector<std::string> params,
+               bool expectTuples);
+    ~AsyncQuery() override = default;
+
+    // Queue the next command in libpq and arm the socket
+    bool sendQuery(const std::string& query);
+    bool sendPrepare();
+    bool sendExecute();
+
+    // AsyncOperation
+    bool onResult(ResultPtr result) override;
+    void onError(const std::string& message) override;
+
+    // The in-flight command finished with result_, returns false when done
+    bool onCommandDone();
+
+    // Deliver the outcome and destroy this object
+    void finish();
+
+    folly::Promise<ResultPtr> promise_;
+    ResultPtr result_;
+
+    std::shared_ptr<const PreparedStatement> statement_;
+    std::vector<std::string> params_;
+    std::vector<const char*> paramValues_;
+
+    Phase phase_ = Phase::Executing;
+    bool expectTuples_;
+    bool retried_ = false;
+    // SQLSTATE of a failed result, passed on with the error
+    std::string sqlState_;
+};
+
+} // namespace db
+} // namespace securapp
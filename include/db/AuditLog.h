@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <folly/MPMCQueue.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace db {
+
+// One row of audit_log
+struct AuditEvent {
+    uint64_t timestampUs = 0;  // wall clock, microseconds since the epoch
+    int64_t userId = 0;        // 0 for none
+    std::string action;        // e.g. "LOGIN"; empty only for the writer's wake-up
+    std::string resourceType;
+    std::string resourceId;    // empty for none
+    std::string details;       // serialized JSON object, empty for none
+    std::string ipAddress;
+    std::string userAgent;
+};
+
+// Audit log settings (the "audit" object of the logging config)
+struct AuditLogOptions {
+    bool enabled = true;
+    // Events waiting to be written at most (queue_size)
+    size_t queueSize = 8192;
+    // Rows sent per COPY (batch_size); a full batch is written at once
+    size_t batchSize = 500;
+    // A partial batch is written after this long (flush_ms)
+    std::chrono::milliseconds flushInterval{1000};
+    // What record() does when the queue is full (overflow): "drop" the
+    // event at once, or "block" the caller for up to blockTimeout first
+    bool blockWhenFull = false;
+    std::chrono::milliseconds blockTimeout{10};
+
+    static AuditLogOptions fromConfig(const json& auditConfig);
+};
+
+// Security events written to audit_log off the request path. Handlers
+// queue events on a bounded lock-free queue; one writer thread collects
+// them into batches and sends each batch with a single COPY, so a busy
+// server costs the database one statement per batch rather than one
+// INSERT per event. What is queued when the writer stops is written first.
+class AuditLog {
+public:
+    static AuditLog& getInstance();
+
+    // Start the writer thread. Call once the database is initialized.
+    void start(const AuditLogOptions& options);
+
+    // Write out every queued event and stop the writer thread. Call before
+    // the database is closed.
+    void stop();
+
+    // Queue an event from any thread; the timestamp is set if missing.
+    // Returns false if it was dropped (queue full or log not running).
+    bool record(AuditEvent event);
+
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    AuditLog() = default;
+    ~AuditLog();
+
+    AuditLog(const AuditLog&) = delete;
+    AuditLog& operator=(const AuditLog&) = delete;
+
+    void writeLoop();
+
+    // Write batch[begin, end). A range refused because a user was deleted
+    // after its events were queued is split until the offending events are
+    // found, and those are written without a user id. On any other failure
+    // returns false; 'written' counts the events stored, always a prefix.
+    bool write(std::vector<AuditEvent>& batch, size_t begin, size_t end,
+               std::string& buffer, size_t& written);
+
+    // COPY batch[begin, end) into audit_log; false if the database refused
+    // it, with the SQLSTATE in 'sqlState'
+    bool flush(const std::vector<AuditEvent>& batch, size_t begin, size_t end,
+               std::string& buffer, std::string& sqlState);
+
+    std::atomic<bool> running_{false};
+    std::atomic<bool> stopping_{false};
+    AuditLogOptions options_;
+    // Created by the first start() and kept for the singleton's lifetime, so
+    // a record() racing with stop() never touches a freed queue
+    std::unique_ptr<folly::MPMCQueue<AuditEvent>> queue_;
+    std::thread writer_;
+
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    size_t writtenCounter_ = 0;
+    size_t droppedCounter_ = 0;
+};
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <postgresql/libpq-fe.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/Promise.h>
+#include <folly/io/async/EventBase.h>
+#include <nlohmann/json.hpp>
+#include "db/PreparedStatement.h"
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace db {
+
+// Pool sizing and timeouts (the "pool" object of the database config)
+struct PoolOptions {
+    size_t minConnections = 2;
+    size_t maxConnections = 16;
+    std::chrono::milliseconds idleTimeout{300000};
+    std::chrono::milliseconds checkoutTimeout{5000};
+
+    // Build options from config, falling back to the defaults above
+    static PoolOptions fromConfig(const json& poolConfig);
+};
+
+// Point-in-time snapshot of the pool counters
+struct PoolStats {
+    size_t total = 0;
+    size_t idle = 0;
+    uint64_t checkouts = 0;
+    uint64_t checkoutTimeouts = 0;
+    uint64_t checkoutWaitTotalUs = 0;
+    uint64_t checkoutWaitMaxUs = 0;
+    uint64_t reconnects = 0;
+};
+
+// A single libpq connection owned by the pool
+class PgConnection {
+public:
+    explicit PgConnection(PGconn* conn);
+    ~PgConnection();
+
+    PgConnection(const PgConnection&) = delete;
+    PgConnection& operator=(const PgConnection&) = delete;
+
+    PGconn* get() const { return conn_; }
+
+    // Check that the connection is usable for a new query
+    bool isHealthy() const;
+
+    // Re-establish a broken connection, returns true on success.
+    // Server-side prepared statements are lost and will be re-prepared.
+    bool reset();
+
+    // Prepared statement bookkeeping for this session
+    bool isPrepared(const std::string& name) const { return prepared_.count(name) != 0; }
+    void markPrepared(const std::string& name) { prepared_.insert(name); }
+    void forgetPrepared(const std::string& name) { prepared_.erase(name); }
+
+    // Prepare the statement on this connection (blocking)
+    bool prepare(const PreparedStatement& statement);
+
+private:
+    friend class ConnectionPool;
+    friend class AsyncConnect;
+
+    PGconn* conn_;
+
+    // Names of the statements already prepared on this session
+    std::unordered_set<std::string> prepared_;
+
+    // Used for idle reaping and thread-affine checkout
+    std::chrono::steady_clock::time_point lastUsed_;
+    std::thread::id lastThread_;
+};
+
+class ConnectionPool;
+
+// Handle for a checked out connection, returns it to the pool when destroyed
+class PooledConnection {
+public:
+    PooledConnection() = default;
+    PooledConnection(ConnectionPool* pool, std::unique_ptr<PgConnection> conn);
+    ~PooledConnection();
+
+    PooledConnection(PooledConnection&& other) noexcept;
+    PooledConnection& operator=(PooledConnection&& other) noexcept;
+
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    explicit operator bool() const { return conn_ != nullptr; }
+
+    PGconn* get() const { return conn_ ? conn_->get() : nullptr; }
+    PgConnection* connection() const { return conn_.get(); }
+
+    // Return the connection to the pool early
+    void release();
+
+private:
+    ConnectionPool* pool_ = nullptr;
+    std::unique_ptr<PgConnection> conn_;
+};
+
+// Bounded pool of PostgreSQL connections shared by all worker threads.
+// Checkout prefers the idle connection last used by the calling thread,
+// so a worker EventBase tends to keep reusing the same connection.
+class ConnectionPool {
+public:
+    ConnectionPool(std::string connStr, PoolOptions options);
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Open the minimum number of connections and start the thread closing
+    // connections idle for longer than the idle timeout
+    bool start();
+
+    // Close all idle connections and fail further checkouts
+    void shutdown();
+
+    // Check out a connection, waiting up to the configured checkout timeout.
+    // Returns an empty handle on timeout or connection failure.
+    PooledConnection acquire();
+    PooledConnection acquire(std::chrono::milliseconds timeout);
+
+    // Check out a connection without blocking the caller. Completes at once
+    // if a connection is idle, otherwise when one is released; fails with
+    // DatabaseError after the checkout timeout. While the pool grows towards
+    // its maximum, and when an idle connection turns out to be broken, the
+    // connection is (re)opened asynchronously on 'evb'.
+    folly::SemiFuture<PooledConnection> acquireAsync(folly::EventBase* evb);
+
+    // True if the pool holds at least one usable connection
+    bool isHealthy() const;
+
+    PoolStats getStats() const;
+
+    const PoolOptions& options() const { return options_; }
+
+private:
+    friend class PooledConnection;
+
+    // Called by PooledConnection to hand a connection back
+    void release(std::unique_ptr<PgConnection> conn);
+
+    // Open a new connection (called without the lock held)
+    std::unique_ptr<PgConnection> connect();
+
+    // Finish an asynchronous checkout that had to (re)connect: hand out the
+    // connection, or give its slot back if connecting failed
+    PooledConnection connected(folly::Try<std::unique_ptr<PgConnection>>&& conn,
+                               bool reconnected,
+                               std::chrono::steady_clock::time_point start);
+
+    // Pick an idle connection, preferring one last used by this thread
+    std::unique_ptr<PgConnection> takeIdleLocked();
+
+    // Move idle connections past the idle timeout into 'expired'
+    void reapIdleLocked(std::vector<std::unique_ptr<PgConnection>>& expired);
+
+    // Reaper thread: closes idle connections even when no traffic comes
+    void reapLoop();
+
+    void recordWait(std::chrono::steady_clock::duration waited);
+
+    // An asynchronous checkout waiting for a released connection
+    struct Waiter {
+        folly::Promise<PooledConnection> promise;
+        std::chrono::steady_clock::time_point since;
+        // Loop to open a connection on if a slot frees up for it
+        folly::EventBase* evb;
+        // Set once the checkout timed out; nothing is handed to it then
+        std::shared_ptr<std::atomic<bool>> abandoned;
+    };
+
+    // A slot was given up without a connection coming back (one was
+    // dropped, or connecting failed). The oldest async waiter keeps the
+    // slot and gets a new connection; without one the slot is freed.
+    void freeSlot();
+
+    // Open a connection on the waiter's loop and hand it over
+    void connectFor(Waiter waiter);
+
+    // Take the oldest waiter still waiting; timed out ones before it are
+    // moved to 'abandoned' so they are destroyed outside the lock
+    std::optional<Waiter> takeWaiterLocked(std::vector<Waiter>& abandoned);
+
+    const std::string connStr_;
+    const PoolOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable available_;
+    std::condition_variable reaperWake_;
+    std::thread reaper_;
+    std::vector<std::unique_ptr<PgConnection>> idle_;
+    std::deque<Waiter> waiters_;
+    size_t total_ = 0;
+    bool shutdown_ = false;
+
+    // Metrics
+    std::atomic<uint64_t> checkouts_{0};
+    std::atomic<uint64_t> checkoutTimeouts_{0};
+    std::atomic<uint64_t> checkoutWaitTotalUs_{0};
+    std::atomic<uint64_t> checkoutWaitMaxUs_{0};
+    std::atomic<uint64_t> reconnects_{0};
+    size_t waitHistogram_;
+};
+
+} // namespace db
+} // namespace securapp
@@ -1,31 +1,59 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
 #include <string>
 #include <memory>
+#include <shared_mutex>
 #include <vector>
 #include <unordered_map>
 #include <postgresql/libpq-fe.h>
 #include <nlohmann/json.hpp>
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBase.h>
+#include "db/ConnectionPool.h"
+#include "db/PgResult.h"
+#include "db/PgTypes.h"
+#include "db/PreparedStatement.h"
+#include "db/QueryBatch.h"
+#include "db/ResultCache.h"
+#include "db/RowStream.h"
 
 using json = nlohmann::json;
 
 namespace securapp {
 namespace db {
 
+// Where the time of an asynchronous statement went. Filled on the event
+// loop the call continues on; read it once the returned future completes.
+struct QueryTiming {
+    std::chrono::steady_clock::time_point queued;    // call made
+    std::chrono::steady_clock::time_point acquired;  // connection checked out
+    std::chrono::steady_clock::time_point finished;  // last result read
+};
+
+// Turns the result of a cached statement into response bytes. It must
+// depend on nothing but the result, as the bytes are served to every later
+// call with the same parameters; nullptr means nothing to cache.
+using ResultSerializer = std::function<std::unique_ptr<folly::IOBuf>(const PGresult*)>;
+
 class DatabaseManager {
 public:
     // Singleton instance
     static DatabaseManager& getInstance();
 
-    // Initialize connection from config
+    // Initialize the connection pool from config
     bool initialize(const json& dbConfig);
 
-    // Close connection
+    // Close all pooled connections
     void close();
 
-    // Check if connection is active
+    // Check if the pool has a usable connection
     bool isConnected() const;
 
+    // Pool counters (checkout wait, reconnects, sizes)
+    PoolStats getPoolStats() const;
+
     // Execute a query that doesn't return any results
     bool execute(const std::string& query);
 
@@ -38,7 +66,112 @@ public:
     // Execute a parameterized query and return results as JSON
     json executeQueryParams(const std::string& query, const std::vector<std::string>& params);
 
-    // Begin transaction
+    // Declare a named statement once (typically at startup). It is prepared
+    // lazily on each pooled connection and re-prepared after reconnects.
+    bool registerStatement(const std::string& name, const std::string& sql,
+                           std::vector<Oid> paramTypes = {},
+                           bool binaryResults = false);
+
+    // Look up a registered statement, nullptr if unknown
+    std::shared_ptr<const PreparedStatement> findStatement(const std::string& name) const;
+
+    // Execute a registered statement that doesn't return results
+    bool executePrepared(const std::string& name, const std::vector<std::string>& params);
+
+    // Execute a registered statement and return results as JSON
+    json executeQueryPrepared(const std::string& name, const std::vector<std::string>& params);
+
+    // Run all statements of the batch in one round trip (pipeline mode)
+    std::vector<BatchResult> executeBatch(const QueryBatch& batch);
+
+    // Send 'data' (COPY text format) through a COPY ... FROM STDIN statement.
+    // On failure 'sqlState', if given, receives the server's SQLSTATE.
+    bool copyIn(const std::string& copySql, const std::string& data,
+                std::string* sqlState = nullptr);
+
+    // Convert a result to a JSON array of typed row objects
+    json resultToJson(PGresult* result);
+
+    // Non-blocking variants. The query is driven by the given EventBase (the
+    // calling thread's when null) and the futures fail with DatabaseError.
+    // They always use a fresh pooled connection, never an open transaction.
+    folly::SemiFuture<ResultPtr> queryAsync(const std::string& query,
+                                            std::vector<std::string> params,
+                                            bool expectTuples,
+                                            folly::EventBase* evb = nullptr);
+
+    // Execute a parameterized query without results asynchronously
+    folly::SemiFuture<folly::Unit> executeParamsAsync(const std::string& query,
+                                                      std::vector<std::string> params,
+                                                      folly::EventBase* evb = nullptr);
+
+    // Execute a parameterized query asynchronously and return results as JSON
+    folly::SemiFuture<json> executeQueryParamsAsync(const std::string& query,
+                                                    std::vector<std::string> params,
+                                                    folly::EventBase* evb = nullptr);
+
+    // Serve the results of a registered statement from the result cache
+    // until one of 'tables' changes. Call at startup, after registering the
+    // statement and before startResultCache(); does nothing if the cache is
+    // disabled.
+    bool cacheResults(const std::string& name, const std::vector<std::string>& tables);
+
+    // Start listening for table changes, once every cacheResults() call is
+    // made. Nothing is served from the cache before.
+    void startResultCache();
+
+    // Run a registered statement asynchronously and serialize its result.
+    // Statements with cacheResults() are answered from the cache when it
+    // holds current bytes for the same parameters, without a query or
+    // serialization; 'timing' is left unset then.
+    folly::SemiFuture<std::unique_ptr<folly::IOBuf>> cachedPreparedAsync(
+        const std::string& name,
+        std::vector<std::string> params,
+        ResultSerializer serialize,
+        folly::EventBase* evb = nullptr,
+        std::shared_ptr<QueryTiming> timing = nullptr);
+
+    // Run a registered statement asynchronously
+    folly::SemiFuture<ResultPtr> preparedAsync(const std::string& name,
+                                               std::vector<std::string> params,
+                                               bool expectTuples,
+                                               folly::EventBase* evb = nullptr,
+                                               std::shared_ptr<QueryTiming> timing = nullptr);
+
+    // Execute a registered statement without results asynchronously
+    folly::SemiFuture<folly::Unit> executePreparedAsync(const std::string& name,
+                                                        std::vector<std::string> params,
+                                                        folly::EventBase* evb = nullptr,
+                                                        std::shared_ptr<QueryTiming> timing = nullptr);
+
+    // Execute a registered statement asynchronously and return results as JSON
+    folly::SemiFuture<json> executeQueryPreparedAsync(const std::string& name,
+                                                      std::vector<std::string> params,
+                                                      folly::EventBase* evb = nullptr);
+
+    // Pipeline a batch asynchronously, one BatchResult per statement
+    folly::SemiFuture<std::vector<BatchResult>> executeBatchAsync(QueryBatch batch,
+                                                                  folly::EventBase* evb = nullptr);
+
+    // Stream the rows of a query as one JSON array, delivered in chunks as
+    // the server produces them (single-row mode). 'control' lets the
+    // consumer pause reads while it cannot keep up, or cancel.
+    folly::SemiFuture<folly::Unit> streamQueryAsync(const std::string& query,
+                                                    std::vector<std::string> params,
+                                                    RowChunkCallback onChunk,
+                                                    std::shared_ptr<StreamControl> control,
+                                                    folly::EventBase* evb = nullptr);
+
+    // Stream the rows of a registered statement
+    folly::SemiFuture<folly::Unit> streamPreparedAsync(const std::string& name,
+                                                       std::vector<std::string> params,
+                                                       RowChunkCallback onChunk,
+                                                       std::shared_ptr<StreamControl> control,
+                                                       folly::EventBase* evb = nullptr,
+                                                       std::shared_ptr<QueryTiming> timing = nullptr);
+
+    // Begin transaction. The connection stays pinned to the calling thread
+    // until commitTransaction() or rollbackTransaction().
     bool beginTransaction();
 
     // Commit transaction
@@ -55,8 +188,18 @@ private:
     DatabaseManager(const DatabaseManager&) = delete;
     DatabaseManager& operator=(const DatabaseManager&) = delete;
 
-    // Database connection
-    PGconn* conn_;
+    // Connection pool shared by all worker threads
+    std::unique_ptr<ConnectionPool> pool_;
+
+    // Serialized results of cacheable statements, null if disabled. Shared
+    // with the continuations of queries still in flight.
+    std::shared_ptr<ResultCache> resultCache_;
+    // Connection string for the cache's listener
+    std::string connStr_;
+
+    // Registered statements by name
+    mutable std::shared_mutex statementsMutex_;
+    std::unordered_map<std::string, std::shared_ptr<const PreparedStatement>> statements_;
 
     // Connection parameters
     std::string host_;
@@ -66,8 +209,28 @@ private:
     std::string dbname_;
     std::string sslMode_;
 
-    // Helper to convert PGresult to JSON
-    json resultToJson(PGresult* result);
+    // Minimum size of a streamed chunk
+    size_t streamChunkBytes_ = 64 * 1024;
+
+    // Check out a connection, or reuse the one pinned by an open transaction
+    PooledConnection* checkout(PooledConnection& holder);
+
+    // Run a query (with optional parameters) on a pooled connection.
+    // Returns nullptr and logs on failure.
+    ResultPtr run(const std::string& query, const std::vector<std::string>* params,
+                  bool expectTuples);
+
+    // Run a registered statement on a pooled connection, preparing it first
+    // if needed. Returns nullptr and logs on failure.
+    ResultPtr runPrepared(const PreparedStatement& statement,
+                          const std::vector<std::string>& params,
+                          bool expectTuples);
+
+    // Resolve the prepared statements a batch refers to (nullptr for plain
+    // SQL entries). Returns false and sets 'error' on an unknown name.
+    bool resolveBatch(const QueryBatch& batch,
+                      std::vector<std::shared_ptr<const PreparedStatement>>& statements,
+                      std::string& error) const;
 };
 
 } // namespace db
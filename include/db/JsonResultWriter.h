@@ -0,0 +1,73 @@
+#pragma once
+
+#include "db/ResultConverter.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <folly/Range.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <postgresql/libpq-fe.h>
+
+namespace securapp {
+namespace db {
+
+// Serializes PGresult rows straight into a chained IOBuf as JSON, without
+// building a json DOM or an intermediate std::string. Values are typed the
+// same way as ResultConverter; object keys follow the column order.
+class JsonResultWriter {
+public:
+    // 'growth' is the size of each IOBuf appended to the chain
+    explicit JsonResultWriter(size_t growth = 16384);
+
+    // Column metadata and pre-rendered keys, computed once per result shape
+    struct RowLayout {
+        std::vector<ColumnInfo> columns;
+        // "name": for each column; empty for columns shadowed by a later
+        // column of the same name
+        std::vector<std::string> keys;
+    };
+
+    static RowLayout layout(const PGresult* result);
+
+    // Append the rows of 'result' as a JSON array of objects
+    void writeRows(const PGresult* result);
+
+    // Append a single row as a JSON object (used when streaming rows)
+    void writeRow(const PGresult* result, int row, const RowLayout& layout);
+
+    // Append pre-serialized JSON (e.g. the envelope around the rows)
+    void writeRaw(folly::StringPiece text);
+
+    // Append a quoted, escaped JSON string
+    void writeString(folly::StringPiece text);
+
+    // Bytes serialized and not yet taken by finish()
+    size_t size() const { return queue_.chainLength(); }
+
+    // Take what has been serialized so far; the writer can keep appending
+    std::unique_ptr<folly::IOBuf> finish();
+
+    // Convenience: the rows of 'result' as a JSON array body
+    static std::unique_ptr<folly::IOBuf> toIOBuf(const PGresult* result);
+
+private:
+    void writeCell(const PGresult* result, int row, int col, const ColumnInfo& column);
+    void writeEscaped(const char* data, size_t length);
+
+    void push(const char* data, size_t length) {
+        appender_.push(reinterpret_cast<const uint8_t*>(data), length);
+    }
+
+    folly::IOBufQueue queue_{folly::IOBufQueue::cacheChainLength()};
+    folly::io::QueueAppender appender_;
+
+    // Scratch space for decoded binary values
+    std::string scratch_;
+};
+
+} // namespace db
+} // namespace securapp
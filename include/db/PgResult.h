@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <postgresql/libpq-fe.h>
+
+namespace securapp {
+namespace db {
+
+// Deleter so a PGresult can be owned by a std::unique_ptr
+struct PGresultDeleter {
+    void operator()(PGresult* result) const {
+        if (result) {
+            PQclear(result);
+        }
+    }
+};
+
+// Owning handle for a libpq result
+using ResultPtr = std::unique_ptr<PGresult, PGresultDeleter>;
+
+// Check a result status; with expectTuples only row-returning results pass
+inline bool resultSucceeded(const PGresult* result, bool expectTuples) {
+    ExecStatusType status = result ? PQresultStatus(result) : PGRES_FATAL_ERROR;
+    return expectTuples
+        ? status == PGRES_TUPLES_OK
+        : (status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK);
+}
+
+// True if the result failed with the given SQLSTATE code
+inline bool hasSqlState(const PGresult* result, const char* sqlState) {
+    const char* code = result ? PQresultErrorField(result, PG_DIAG_SQLSTATE) : nullptr;
+    return code && std::strcmp(code, sqlState) == 0;
+}
+
+// SQLSTATE raised when a prepared statement does not exist on the session
+constexpr const char* kSqlStateUndefinedStatement = "26000";
+
+// SQLSTATE raised when an insert or update breaks a unique constraint
+constexpr const char* kSqlStateUniqueViolation = "23505";
+
+// SQLSTATE raised when a row references a key that does not exist
+constexpr const char* kSqlStateForeignKeyViolation = "23503";
+
+// Error carried by failed asynchronous database operations
+class DatabaseError : public std::runtime_error {
+public:
+    explicit DatabaseError(const std::string& message, std::string sqlState = std::string())
+        : std::runtime_error(message), sqlState_(std::move(sqlState)) {}
+
+    // SQLSTATE reported by the server, empty if the statement never ran
+    const std::string& sqlState() const { return sqlState_; }
+
+private:
+    std::string sqlState_;
+};
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <postgresql/libpq-fe.h>
+
+namespace securapp {
+namespace db {
+
+// Built-in PostgreSQL type OIDs (from pg_type.dat). The server catalog
+// headers are not part of the libpq client package, so the ones we use are
+// listed here.
+namespace pgtype {
+
+constexpr Oid kBool = 16;
+constexpr Oid kBytea = 17;
+constexpr Oid kInt8 = 20;
+constexpr Oid kInt2 = 21;
+constexpr Oid kInt4 = 23;
+constexpr Oid kText = 25;
+constexpr Oid kOid = 26;
+constexpr Oid kJson = 114;
+constexpr Oid kFloat4 = 700;
+constexpr Oid kFloat8 = 701;
+constexpr Oid kVarchar = 1043;
+constexpr Oid kDate = 1082;
+constexpr Oid kTimestamp = 1114;
+constexpr Oid kTimestampTz = 1184;
+constexpr Oid kNumeric = 1700;
+constexpr Oid kUuid = 2950;
+constexpr Oid kJsonb = 3802;
+
+} // namespace pgtype
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <postgresql/libpq-fe.h>
+
+namespace securapp {
+namespace db {
+
+// A query declared once by name and prepared lazily on every pooled
+// connection the first time it runs there
+struct PreparedStatement {
+    // Dense index assigned at registration
+    size_t id = 0;
+
+    // Server-side statement name
+    std::string name;
+
+    // SQL text with $1..$n placeholders
+    std::string sql;
+
+    // Parameter type OIDs (see PgTypes.h); empty lets the server infer them
+    std::vector<Oid> paramTypes;
+
+    // Request results in binary format (resultFormat = 1). Cheaper to
+    // produce and decode for numeric and timestamp heavy rows.
+    bool binaryResults = false;
+
+    // Metrics histogram of execution times (util::Metrics id)
+    size_t latencyHistogram = static_cast<size_t>(-1);
+
+    // libpq resultFormat argument for this statement
+    int resultFormat() const { return binaryResults ? 1 : 0; }
+};
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "db/ConnectionPool.h"
+#include "db/PgResult.h"
+#include "db/PreparedStatement.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef LIBPQ_HAS_PIPELINING
+#error "libpq 14 or newer is required for pipeline mode"
+#endif
+
+namespace securapp {
+namespace db {
+
+// Outcome of one statement in a batch
+struct BatchResult {
+    bool ok = false;
+    ResultPtr result;
+    std::string error;
+};
+
+// Statements to send to the server in a single round trip using libpq
+// pipeline mode. Everything up to the pipeline sync point runs in one
+// implicit transaction: if a statement fails, the ones after it are skipped
+// and the effects of the ones before it are rolled back.
+class QueryBatch {
+public:
+    // Queue a SQL statement with parameters
+    QueryBatch& add(std::string query, std::vector<std::string> params = {},
+                    bool expectTuples = false);
+
+    // Queue a registered prepared statement
+    QueryBatch& addPrepared(std::string name, std::vector<std::string> params = {},
+                            bool expectTuples = false);
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+    // A queued statement; 'text' is the SQL or the statement name
+    struct Entry {
+        std::string text;
+        bool prepared = false;
+        std::vector<std::string> params;
+        bool expectTuples = false;
+    };
+
+    const std::vector<Entry>& entries() const { return entries_; }
+
+private:
+    std::vector<Entry> entries_;
+};
+
+// One pipeline execution of a batch on a connection: queues the commands,
+// then matches the results coming back to the statements they belong to.
+// Used by both the blocking and the EventBase-driven paths.
+class PipelineRun {
+public:
+    // 'statements' runs parallel to the batch entries (nullptr for plain SQL)
+    PipelineRun(PgConnection* session,
+                const QueryBatch& batch,
+                std::vector<std::shared_ptr<const PreparedStatement>> statements);
+
+    // Enter pipeline mode and queue every command plus the sync point
+    bool send(std::string& error);
+
+    // Feed the next result from PQgetResult (nullptr ends a command).
+    // Returns true once the sync point has been reached.
+    bool consume(ResultPtr result);
+
+    // The result stream did not match what was sent
+    bool broken() const { return broken_; }
+
+    // Leave pipeline mode and hand out the per-statement results
+    std::vector<BatchResult> finish();
+
+private:
+    // A command sent to the server, in order
+    struct Step {
+        bool prepare;
+        size_t entry;
+    };
+
+    // All results for plan_[cursor_] have arrived
+    void finishStep();
+
+    PgConnection* session_;
+    const QueryBatch& batch_;
+    std::vector<std::shared_ptr<const PreparedStatement>> statements_;
+
+    std::vector<Step> plan_;
+    size_t cursor_ = 0;
+    ResultPtr current_;
+    std::vector<BatchResult> results_;
+    bool broken_ = false;
+};
+
+} // namespace db
+} // namespace securapp
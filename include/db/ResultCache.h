@@ -0,0 +1,137 @@
+#pragma once
+
+#include "util/LruTable.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <folly/io/IOBuf.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace db {
+
+// Result cache settings (the "result_cache" object of the database config)
+struct ResultCacheOptions {
+    bool enabled = false;
+    // Serialized bytes kept at most; the least recently used go first
+    size_t maxBytes = 64 * 1024 * 1024;
+    // Entries kept at most, however small
+    size_t maxEntries = 100000;
+    // NOTIFY channel the table triggers signal on (see database/init.sql)
+    std::string channel = "table_changes";
+
+    static ResultCacheOptions fromConfig(const json& cacheConfig);
+};
+
+// Serialized results of registered statements, keyed by statement and
+// parameters. A hit is answered with the stored bytes, skipping both the
+// round trip and the serialization.
+//
+// Entries are invalidated by table: triggers NOTIFY the table name when a
+// table changes, and a listener thread on a dedicated connection bumps the
+// table's generation. An entry remembers the generations of its tables as
+// of before its query ran, so a change committed during the query already
+// makes it stale. While the listener is disconnected changes could be
+// missed, so nothing is served or stored, and every entry is dropped when
+// it reconnects.
+class ResultCache {
+public:
+    explicit ResultCache(const ResultCacheOptions& options);
+    ~ResultCache();
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Start listening for table changes on a connection of its own. The
+    // listener reads the table list, so call it after every
+    // cacheStatement().
+    void start(const std::string& connStr);
+
+    // Stop the listener thread
+    void stop();
+
+    // Cache the results of 'statement' until one of 'tables' changes. Call
+    // at startup, before start() and before any query runs.
+    void cacheStatement(const std::string& statement, const std::vector<std::string>& tables);
+
+    // Whether results of 'statement' are cached
+    bool caches(const std::string& statement) const { return policies_.count(statement) != 0; }
+
+    // Current generation of the tables of 'statement'; take it before
+    // running the query and pass it to store()
+    uint64_t generation(const std::string& statement) const;
+
+    // Cache key of a statement call
+    static std::string key(const std::string& statement, const std::vector<std::string>& params);
+
+    // Stored bytes for 'key' if still current, sharing the cached buffer
+    std::unique_ptr<folly::IOBuf> lookup(const std::string& key, uint64_t generation);
+
+    // Keep a copy of 'body' for 'key', produced by a query that started at
+    // 'generation'
+    void store(const std::string& key, uint64_t generation, const folly::IOBuf& body);
+
+    // Drop every entry (by making all of them stale)
+    void invalidateAll();
+
+private:
+    static constexpr size_t kShards = 16;
+
+    // Change counter of one table
+    using Generation = std::atomic<uint64_t>;
+
+    struct Entry {
+        std::string key;  // the full key; hashes can collide
+        uint64_t generation = 0;
+        std::unique_ptr<folly::IOBuf> body;
+        size_t bytes = 0;
+    };
+
+    struct alignas(64) Shard {
+        explicit Shard(size_t capacity) : entries(capacity) {}
+
+        std::mutex mutex;
+        util::LruTable<Entry> entries;
+        size_t bytes = 0;
+    };
+
+    Shard& shardFor(uint64_t hash) { return *shards_[(hash >> 32) % kShards]; }
+
+    // Generation counter of 'table', created on first use
+    Generation* table(const std::string& name);
+
+    void listenLoop(std::string connStr);
+
+    // Bump the generation of the table named in a notification
+    void tableChanged(const std::string& name);
+
+    ResultCacheOptions options_;
+    size_t shardBytes_;
+    std::array<std::unique_ptr<Shard>, kShards> shards_;
+
+    // Tables and the statements depending on them; fixed before the
+    // listener starts, read without a lock afterwards
+    std::unordered_map<std::string, std::unique_ptr<Generation>> tables_;
+    std::unordered_map<std::string, std::vector<const Generation*>> policies_;
+
+    // Nothing is served while changes could go unnoticed
+    std::atomic<bool> listening_{false};
+    std::atomic<bool> stopping_{false};
+    std::thread listener_;
+
+    size_t hitCounter_;
+    size_t missCounter_;
+    size_t invalidationCounter_;
+};
+
+} // namespace db
+} // namespace securapp
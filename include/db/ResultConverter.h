@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <postgresql/libpq-fe.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace db {
+
+// JSON shape a PostgreSQL column is rendered as
+enum class ColumnKind {
+    Integer,    // int2, int4, int8, oid
+    Float,      // float4, float8
+    Bool,       // bool
+    Numeric,    // numeric, kept as a string to preserve precision
+    Json,       // json, jsonb, embedded as a nested value
+    Timestamp,  // timestamp, timestamptz, date as ISO 8601 strings
+    Text        // everything else
+};
+
+// Per-result column metadata, computed once before walking the rows
+struct ColumnInfo {
+    std::string name;
+    Oid type;
+    ColumnKind kind;
+    bool binary;
+};
+
+// Converts PGresults into typed JSON. Handles both the text and the binary
+// (resultFormat = 1) wire formats; binary values of types without a decoder
+// are emitted hex-encoded like bytea.
+class ResultConverter {
+public:
+    // Convert a result to a JSON array of row objects
+    static json toJson(const PGresult* result);
+
+    // Column names, types and formats of a result
+    static std::vector<ColumnInfo> describe(const PGresult* result);
+
+    // JSON shape for a type OID
+    static ColumnKind kindOf(Oid type);
+
+    // Convert a single non-null cell
+    static json cellToJson(const PGresult* result, int row, int col, const ColumnInfo& column);
+
+    // Render a binary-format value as the text it would have in text format.
+    // Returns false if the type has no binary decoder.
+    static bool binaryToText(Oid type, const char* data, size_t length, std::string& out);
+
+    // Big-endian integer decoding for binary-format values
+    static int64_t readInt(const char* data, size_t length);
+};
+
+} // namespace db
+} // namespace securapp
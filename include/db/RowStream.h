@@ -0,0 +1,143 @@
+#pragma once
+
+#include "db/AsyncOperation.h"
+#include "db/JsonResultWriter.h"
+#include "db/PreparedStatement.h"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <folly/futures/Future.h>
+#include <folly/futures/Promise.h>
+#include <folly/io/IOBuf.h>
+
+namespace securapp {
+namespace db {
+
+class RowStream;
+
+// Flow control shared by a RowStream and its consumer. The consumer creates
+// it before the stream starts (the connection may not be checked out yet).
+// All methods run on the EventBase thread.
+class StreamControl {
+public:
+    // Stop reading rows from the server until resume()
+    void pause();
+
+    // Continue reading; buffered rows may be delivered before this returns
+    void resume();
+
+    // The consumer went away: stop delivering rows and drop the connection
+    void cancel();
+
+    bool paused() const { return paused_; }
+    bool cancelled() const { return cancelled_; }
+
+private:
+    friend class RowStream;
+
+    RowStream* stream_ = nullptr;
+    bool paused_ = false;
+    bool cancelled_ = false;
+};
+
+// Receives serialized rows; together the chunks form one JSON array
+using RowChunkCallback = std::function<void(std::unique_ptr<folly::IOBuf>)>;
+
+// A query whose rows are fetched in libpq single-row mode and serialized as
+// they arrive, so memory stays bounded by the chunk size no matter how large
+// the result is. The object owns itself and is deleted once the last chunk
+// has been delivered.
+class RowStream : public AsyncOperation {
+public:
+    // Run 'query' on 'conn', handing chunks of at least 'chunkBytes' (the
+    // last one may be smaller) to 'onChunk'. Completes once the closing
+    // chunk has been delivered; fails with DatabaseError if the query fails,
+    // possibly after some chunks were already delivered. Must be called on
+    // the EventBase thread.
+    static folly::SemiFuture<folly::Unit> start(
+        folly::EventBase* evb,
+        PooledConnection conn,
+        const std::string& query,
+        std::vector<std::string> params,
+        RowChunkCallback onChunk,
+        std::shared_ptr<StreamControl> control,
+        size_t chunkBytes);
+
+    // Same for a registered statement, prepared first if needed
+    static folly::SemiFuture<folly::Unit> start(
+        folly::EventBase* evb,
+        PooledConnection conn,
+        std::shared_ptr<const PreparedStatement> statement,
+        std::vector<std::string> params,
+        RowChunkCallback onChunk,
+        std::shared_ptr<StreamControl> control,
+        size_t chunkBytes);
+
+private:
+    friend class StreamControl;
+
+    // Which command is in flight on the connection
+    enum class Phase { Preparing, Executing };
+
+    RowStream(folly::EventBase* evb,
+              PooledConnection conn,
+              std::vector<std::string> params,
+              RowChunkCallback onChunk,
+              std::shared_ptr<StreamControl> control,
+              size_t chunkBytes);
+    ~RowStream() override;
+
+    // Shared setup of both start() overloads; false if already cancelled
+    bool attach();
+
+    // Queue the next command in libpq and arm the socket
+    bool sendQuery(const std::string& query);
+    bool sendPrepare();
+    bool sendExecute();
+
+    // Switch the command just sent to single-row mode and flush it
+    bool streamRows();
+
+    // AsyncOperation
+    bool onResult(ResultPtr result) override;
+    void onError(const std::string& message) override;
+
+    // The in-flight command finished, returns false when done
+    bool onCommandDone();
+
+    // Hand the rows serialized so far to the consumer. Returns false if
+    // the consumer cancelled from the callback (the object is gone).
+    bool deliver();
+
+    // Consumer-initiated stop from StreamControl::cancel()
+    void cancel();
+
+    // Deliver the outcome and destroy this object
+    void finish();
+
+    folly::Promise<folly::Unit> promise_;
+    RowChunkCallback onChunk_;
+    std::shared_ptr<StreamControl> control_;
+    size_t chunkBytes_;
+
+    JsonResultWriter writer_;
+    std::optional<JsonResultWriter::RowLayout> layout_;
+    size_t rows_ = 0;
+
+    // Final status of the command, or its first error
+    ResultPtr status_;
+
+    std::shared_ptr<const PreparedStatement> statement_;
+    std::vector<std::string> params_;
+    std::vector<const char*> paramValues_;
+
+    Phase phase_ = Phase::Executing;
+    bool retried_ = false;
+    bool delivering_ = false;
+};
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "db/DatabaseManager.h"
+#include "util/TokenCache.h"
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBase.h>
+
+namespace securapp {
+namespace db {
+
+// Bearer tokens kept in the user_tokens table, checked through a
+// util::TokenCache so repeated checks of the same token cost no database
+// round trip. Every outcome is cached, including unknown tokens.
+class TokenStore {
+public:
+    static TokenStore& getInstance();
+
+    // Create the cache; call before the server starts
+    void configure(const util::TokenCacheOptions& options);
+
+    // Declare the prepared statements on user_tokens
+    static void registerStatements();
+
+    // Cached answer for 'token', without touching the database
+    std::optional<util::TokenInfo> cached(std::string_view token);
+
+    // Answer for 'token' from user_tokens (unknown, expired and revoked
+    // tokens are invalid); the outcome is cached. Check cached() first.
+    folly::SemiFuture<util::TokenInfo> validate(std::string token, folly::EventBase* evb,
+                                                std::shared_ptr<QueryTiming> timing = nullptr);
+
+    // Record a newly issued token; it is cached as valid right away
+    folly::SemiFuture<folly::Unit> issue(std::string token, int64_t userId,
+                                         std::chrono::seconds lifetime, folly::EventBase* evb,
+                                         std::shared_ptr<QueryTiming> timing = nullptr);
+
+    // Mark 'token' revoked. It is refused on this server at once and until
+    // 'expiresAt'; the future says whether a live token was revoked.
+    folly::SemiFuture<bool> revoke(std::string token, std::chrono::system_clock::time_point expiresAt,
+                                   folly::EventBase* evb,
+                                   std::shared_ptr<QueryTiming> timing = nullptr);
+
+private:
+    TokenStore() = default;
+
+    TokenStore(const TokenStore&) = delete;
+    TokenStore& operator=(const TokenStore&) = delete;
+
+    std::unique_ptr<util::TokenCache> cache_;
+};
+
+} // namespace db
+} // namespace securapp
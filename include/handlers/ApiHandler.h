@@ -1,25 +1,67 @@
 #pragma once
 
 #include "handlers/BaseHandler.h"
+#include <memory>
 
 namespace securapp {
 namespace handlers {
 
 class ApiHandler : public BaseHandler {
 public:
-    explicit ApiHandler(const json& config);
+    // API operations, selected by the router
+    enum class Endpoint {
+        ListUsers,    // GET /api/users
+        CreateUser,   // POST /api/users
+        GetUser,      // GET /api/users/{id}
+        ExportUsers,  // GET /api/users/export
+        Auth,         // POST /api/auth
+        Logout        // DELETE /api/auth
+    };
+
+    explicit ApiHandler(std::shared_ptr<const json> config);
+
+    // Select the operation for the next request
+    void setEndpoint(Endpoint endpoint) { endpoint_ = endpoint; }
     ~ApiHandler() override = default;
 
+    // Declare the prepared statements used by the API endpoints
+    static void registerStatements();
+
 protected:
     void handleRequest() override;
+    std::vector<std::string> requestFields() const override;
 
 private:
     // Handles different API endpoints
-    void handleUsersEndpoint();
+    void handleListUsers();
+    void handleCreateUser();
+    void handleGetUser();
+    void handleUsersExport();
     void handleAuthEndpoint();
+    void handleLogout();
+
+    // Token from "Authorization: Bearer ...", empty if there is none
+    std::string_view bearerToken() const;
+
+    // Call 'next' with the user id once the request's bearer token checks
+    // out; answers 401 otherwise. Cached tokens are checked synchronously.
+    template <typename F>
+    void withUser(F&& next);
+
+    // Send a newly issued token for 'userId'
+    void issueToken(int64_t userId);
+
+    // Queue a security event for audit_log, with the client's address and
+    // user agent
+    void audit(const char* action, const char* resourceType, int64_t userId,
+               std::string resourceId = std::string(), std::string details = std::string());
+
+    // Answer a failed hash or verification; 503 when hashing is saturated
+    void sendHashingError(const folly::exception_wrapper& error);
 
-    // Configuration
-    json config_;
+    // Configuration, shared by all handlers
+    std::shared_ptr<const json> config_;
+    Endpoint endpoint_ = Endpoint::ListUsers;
 };
 
 } // namespace handlers
@@ -1,19 +1,90 @@
 #pragma once
 
 #include <proxygen/httpserver/RequestHandler.h>
+#include <glog/logging.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
+#include <folly/futures/Future.h>
+#include <folly/Range.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/EventBase.h>
 #include <nlohmann/json.hpp>
+#include "db/RowStream.h"
+#include "handlers/Router.h"
+#include "util/Arena.h"
+#include "util/JsonEncoder.h"
+#include "util/JsonStreamParser.h"
+#include "util/JsonView.h"
+#include "util/LoopMonitor.h"
+#include "util/Metrics.h"
+#include "util/RequestTiming.h"
+#include <chrono>
+#include <memory>
 #include <string>
+#include <vector>
 
 using json = nlohmann::json;
 
 namespace securapp {
+namespace db {
+struct QueryTiming;
+} // namespace db
+
 namespace handlers {
 
+// Request body handling, from the "server" config section
+struct BodyOptions {
+    // Larger bodies are rejected with 413 (max_body_size)
+    size_t maxSize = 1024 * 1024;
+    // How JSON bodies are parsed (json_parser)
+    enum class JsonParser {
+        Nlohmann,     // "nlohmann": whole body at the end
+        Incremental,  // "incremental": chunk by chunk as it arrives
+        Simd          // "simdjson": whole body, SIMD parser (if built in)
+    };
+    JsonParser jsonParser = JsonParser::Nlohmann;
+
+    static BodyOptions fromConfig(const json& serverConfig);
+};
+
+// Response serialization, from the "server" config section
+struct ResponseOptions {
+    // Indent JSON responses by default (pretty_json); clients can always
+    // ask for it with ?pretty=1
+    bool prettyJson = false;
+    // Add a Server-Timing header with the phases of the request so far
+    // (server_timing)
+    bool serverTiming = false;
+
+    static ResponseOptions fromConfig(const json& serverConfig);
+};
+
 class BaseHandler : public proxygen::RequestHandler {
 public:
     BaseHandler();
-    virtual ~BaseHandler() = default;
+    virtual ~BaseHandler();
+
+    // Limits and parser choice for the request body
+    void setBodyOptions(const BodyOptions& options) { bodyOptions_ = options; }
+
+    // How JSON responses are written
+    void setResponseOptions(const ResponseOptions& options) { responseOptions_ = options; }
+
+    // Path parameters captured by the router; they point into the request
+    // message, which the handler receives right after
+    void setRouteParams(const RouteParams& params) { routeParams_ = params; }
+
+    // Latency histograms of the route the request matched
+    void setRouteMetrics(const util::RouteMetrics* metrics) { routeMetrics_ = metrics; }
+
+    // Time the request reached the factory; routing ends now
+    void setRequestStart(std::chrono::steady_clock::time_point arrived);
+
+    // Answer 429 with this Retry-After instead of handling the request
+    void setRateLimited(std::chrono::seconds retryAfter) { retryAfter_ = retryAfter; }
+
+    // Where the handler goes once the request is done (deleted if unset)
+    using Recycler = void (*)(BaseHandler*);
+    void setRecycler(Recycler recycler) { recycler_ = recycler; }
 
     // RequestHandler implementation
     void onRequest(std::unique_ptr<proxygen::HTTPMessage> headers) noexcept override;
@@ -22,21 +93,200 @@ public:
     void onUpgrade(proxygen::UpgradeProtocol proto) noexcept override;
     void requestComplete() noexcept override;
     void onError(proxygen::ProxygenError err) noexcept override;
+    void onEgressPaused() noexcept override;
+    void onEgressResumed() noexcept override;
 
 protected:
     // Child classes implement this method to handle the request
     virtual void handleRequest() = 0;
 
-    // Helper methods
+    // Drop all per-request state before the handler is reused. Overrides
+    // must call the base version.
+    virtual void reset();
+
+    // Top-level members of a JSON body the handler reads. With the
+    // incremental parser the others are validated but never stored.
+    // Empty keeps the whole body.
+    virtual std::vector<std::string> requestFields() const { return {}; }
+
+    // Helper methods. JSON values are sent compact, indented with ?pretty=1,
+    // or as MessagePack / CBOR when the Accept header asks for it.
     void sendErrorResponse(uint16_t statusCode, const std::string& errorMessage);
     void sendJsonResponse(uint16_t statusCode, const json& jsonBody);
+    void sendJsonResponse(uint16_t statusCode, const util::ArenaJson& jsonBody);
+
+    // Send an already serialized JSON body (see db::JsonResultWriter); it
+    // is always sent as JSON
+    void sendRawJsonResponse(uint16_t statusCode, std::unique_ptr<folly::IOBuf> body);
+
+    // Send a body of any other type as is
+    void sendRawResponse(uint16_t statusCode, const std::string& contentType,
+                         std::unique_ptr<folly::IOBuf> body);
+
+    // Contiguous view of the request body, followed by at least 'tailroom'
+    // readable bytes. The buffer chain is coalesced only if the body arrived
+    // in more than one piece or lacks the tailroom.
+    folly::ByteRange bodyBytes(size_t tailroom = 0);
+
+    // Stream the rows of a registered statement as a chunked JSON array.
+    // Database reads pause while the client is not keeping up, so memory
+    // stays bounded by the chunk size.
+    void streamPrepared(const std::string& name, std::vector<std::string> params);
+
+    // Continue with 'callback' on this handler's EventBase once 'future'
+    // completes. The callback is skipped if the handler has been destroyed
+    // in the meantime (e.g. the client went away). It runs in a
+    // CallbackScope.
+    template <typename T, typename F>
+    void whenReady(folly::SemiFuture<T>&& future, F&& callback);
+
+    // Timing for the next asynchronous database call: pass it to the
+    // DatabaseManager, and whenReady() adds its connection wait and
+    // execution time to the request's phases. The same object is reused
+    // for every call, so it costs no allocation.
+    std::shared_ptr<db::QueryTiming> queryTiming();
+
+    // Entered whenever request code runs on the loop: makes the request
+    // arena current and tells the loop monitor which route is running
+    class CallbackScope {
+    public:
+        explicit CallbackScope(BaseHandler& handler)
+            : arena_(handler.arena_),
+              activity_(handler.routeMetrics_ ? handler.routeMetrics_->name() : "unrouted request") {}
+
+    private:
+        util::Arena::Scope arena_;
+        util::LoopMonitor::Activity activity_;
+    };
+
+    // EventBase the request arrived on
+    folly::EventBase* evb_ = nullptr;
+
+    // Memory for the request's ArenaJson values, released in one go when
+    // the request completes. It is current in every callback of the
+    // handler, so ArenaJson locals and members need no extra setup; values
+    // must not outlive the request.
+    util::Arena arena_;
 
     // Request data
     std::unique_ptr<proxygen::HTTPMessage> headers_;
-    std::string body_;
-    json jsonBody_;
+    RouteParams routeParams_;
+    folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+    // Parsed JSON body (not filled by the simdjson parser; use bodyView_)
+    util::ArenaJson jsonBody_;
     bool hasJsonBody_ = false;
+
+    // Members of the JSON body, whichever parser produced it. With the
+    // simdjson parser it is only valid until handleRequest() returns, so
+    // copy what asynchronous continuations need.
+    util::JsonView bodyView_;
+
+private:
+    template <typename T>
+    friend class HandlerPool;
+
+    // Recycle or delete the handler once proxygen is done with it
+    void done();
+
+    // Hand the finished request to the metrics and the access log
+    void recordRequest();
+
+    // Answer with an error and ignore the rest of the request
+    void rejectBody(uint16_t statusCode, const std::string& message);
+
+    // Answer 429 for a request over the rate limit
+    void sendTooManyRequests();
+
+    bool isJsonRequest() const;
+
+    // Parse the buffered body; on failure the error response has been sent
+    bool parseBody();
+
+    // Serialize in the negotiated encoding, timed as Phase::Serialize
+    template <typename J>
+    std::unique_ptr<folly::IOBuf> encodeBody(const J& value, size_t sizeHint = 1024);
+
+    // Send a body produced by util::encode() in the negotiated encoding
+    void sendEncoded(uint16_t statusCode, const std::string& reason,
+                     std::unique_ptr<folly::IOBuf> body);
+
+    // Set the status of a response about to go out and add the
+    // Server-Timing header if enabled
+    void beginResponse(proxygen::ResponseBuilder& response, uint16_t statusCode,
+                       const std::string& reason);
+
+    // Add the finished database call, if any, to the request's phases
+    void collectQueryTiming();
+
+    // Keep the request in the slow request log
+    void recordSlowRequest(uint64_t latencyUs);
+
+    BodyOptions bodyOptions_;
+    ResponseOptions responseOptions_;
+    // Picked from Accept and ?pretty when the request arrives
+    util::Encoding encoding_ = util::Encoding::Json;
+    size_t bodyLength_ = 0;
+    Recycler recycler_ = nullptr;
+
+    // Set when the JSON body is parsed as it arrives
+    std::unique_ptr<util::JsonStreamParser> jsonParser_;
+
+    // A response was sent before the request finished arriving
+    bool rejected_ = false;
+
+    // Set by the rate limiter; zero lets the request through
+    std::chrono::seconds retryAfter_{0};
+
+    // Metrics and access log data
+    const util::RouteMetrics* routeMetrics_ = nullptr;
+    std::chrono::steady_clock::time_point requestStart_;
+    uint16_t responseStatus_ = 0;
+    uint64_t responseBytes_ = 0;
+
+    // Phase breakdown of the request
+    util::RequestTiming timing_;
+    std::chrono::steady_clock::time_point bodyStart_;
+    std::chrono::steady_clock::time_point responseStart_;
+    // Timing handed to database calls, allocated once per handler and
+    // reused while no abandoned call still holds it
+    std::shared_ptr<db::QueryTiming> query_;
+    bool queryPending_ = false;
+
+    // Expires when the handler is destroyed, checked by async continuations
+    std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
+
+    // Flow control of the row stream feeding the response, if any
+    std::shared_ptr<db::StreamControl> stream_;
+    bool streamStarted_ = false;
 };
 
+template <typename T, typename F>
+void BaseHandler::whenReady(folly::SemiFuture<T>&& future, F&& callback) {
+    std::weak_ptr<bool> alive = alive_;
+    std::move(future)
+        .via(evb_)
+        .thenTry([this, alive, cb = std::forward<F>(callback)](folly::Try<T>&& result) mutable {
+            if (alive.expired()) {
+                return;
+            }
+            CallbackScope scope(*this);
+            collectQueryTiming();
+            try {
+                cb(std::move(result));
+            } catch (const std::exception& e) {
+                LOG(ERROR) << "Error completing request: " << e.what();
+                sendErrorResponse(500, "Internal server error");
+            }
+        });
+}
+
+template <typename J>
+std::unique_ptr<folly::IOBuf> BaseHandler::encodeBody(const J& value, size_t sizeHint) {
+    auto started = std::chrono::steady_clock::now();
+    auto body = util::encode(value, encoding_, sizeHint);
+    timing_.addSince(util::Phase::Serialize, started);
+    return body;
+}
+
 } // namespace handlers
 } // namespace securapp
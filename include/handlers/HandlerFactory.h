@@ -1,7 +1,11 @@
 #pragma once
 
+#include "handlers/BaseHandler.h"
+#include "handlers/Router.h"
+#include "util/Metrics.h"
 #include <proxygen/httpserver/RequestHandlerFactory.h>
 #include <nlohmann/json.hpp>
+#include <memory>
 
 using json = nlohmann::json;
 
@@ -19,10 +23,31 @@ public:
     proxygen::RequestHandler* onRequest(proxygen::RequestHandler*, proxygen::HTTPMessage* message) noexcept override;
 
 private:
-    // Configuration
-    json config_;
+    // Creates the handler for a matched route
+    using HandlerCreator = BaseHandler* (*)(const std::shared_ptr<const json>& config);
+
+    // A route table entry
+    struct Route {
+        HandlerCreator create;
+        util::RouteMetrics metrics;
+    };
+
+    // Fill the route table; called once from the constructor
+    void buildRoutes();
+
+    void addRoute(RouteMethod method, const std::string& pattern, HandlerCreator create);
+
+    // Configuration, shared read-only with the handlers
+    std::shared_ptr<const json> config_;
+    // Route table, read-only once the server runs
+    Router<Route> router_;
+    // Latency of requests that matched no route
+    util::RouteMetrics unmatchedMetrics_;
     // Server event base
     folly::EventBase* evb_ = nullptr;
+    // Body limits and parser choice passed to every handler
+    BodyOptions bodyOptions_;
+    ResponseOptions responseOptions_;
 };
 
 } // namespace handlers
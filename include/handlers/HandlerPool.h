@@ -0,0 +1,56 @@
+#pragma once
+
+#include "handlers/BaseHandler.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace securapp {
+namespace handlers {
+
+// Per-thread freelist of handlers of one type. proxygen creates and
+// completes a handler on the same EventBase thread, so the lists need no
+// locking. Completed handlers are reset and handed out again instead of
+// being deleted; constructor arguments are only used when the list is empty,
+// so they must be the same for every request (e.g. shared config).
+template <typename T>
+class HandlerPool {
+public:
+    // Idle handlers kept per thread; extra ones are deleted
+    static constexpr size_t kMaxIdle = 256;
+
+    template <typename... Args>
+    static T* acquire(Args&&... args) {
+        auto& idle = freelist();
+        T* handler;
+        if (!idle.empty()) {
+            handler = idle.back().release();
+            idle.pop_back();
+        } else {
+            handler = new T(std::forward<Args>(args)...);
+        }
+        handler->setRecycler(&HandlerPool::release);
+        return handler;
+    }
+
+private:
+    // Called by the handler once proxygen is done with it
+    static void release(BaseHandler* handler) {
+        auto& idle = freelist();
+        if (idle.size() >= kMaxIdle) {
+            delete handler;
+            return;
+        }
+        handler->reset();
+        idle.emplace_back(static_cast<T*>(handler));
+    }
+
+    static std::vector<std::unique_ptr<T>>& freelist() {
+        thread_local std::vector<std::unique_ptr<T>> idle;
+        return idle;
+    }
+};
+
+} // namespace handlers
+} // namespace securapp
@@ -10,8 +10,15 @@ public:
     HealthCheckHandler() = default;
     ~HealthCheckHandler() override = default;
 
+    // Declare the prepared statement used for the database ping
+    static void registerStatements();
+
 protected:
     void handleRequest() override;
+
+private:
+    // Send the health report once the database check is done
+    void sendHealth(bool dbConnected);
 };
 
 } // namespace handlers
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "handlers/BaseHandler.h"
+
+namespace securapp {
+namespace handlers {
+
+class MethodNotAllowedHandler : public BaseHandler {
+public:
+    MethodNotAllowedHandler() = default;
+    ~MethodNotAllowedHandler() override = default;
+
+protected:
+    void handleRequest() override;
+};
+
+} // namespace handlers
+} // namespace securapp
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "handlers/BaseHandler.h"
+
+namespace securapp {
+namespace handlers {
+
+// Serves the counters and histograms of util::Metrics, plus values read at
+// scrape time (database pool, access log), in the Prometheus text format
+class MetricsHandler : public BaseHandler {
+public:
+    MetricsHandler() = default;
+    ~MetricsHandler() override = default;
+
+protected:
+    void handleRequest() override;
+};
+
+} // namespace handlers
+} // namespace securapp
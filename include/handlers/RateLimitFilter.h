@@ -0,0 +1,36 @@
+#pragma once
+
+#include "util/Metrics.h"
+#include "util/RateLimiter.h"
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <nlohmann/json.hpp>
+#include <memory>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace handlers {
+
+// First factory of the handler chain, enforcing security.rate_limit per
+// client IP. Requests within the limit get the next factory's handler
+// unchanged, so they pay for one bucket check and nothing else. Over the
+// limit, that handler is told to answer 429 instead of running, so the
+// response still reaches its route metrics and the access log.
+class RateLimitFilterFactory : public proxygen::RequestHandlerFactory {
+public:
+    explicit RateLimitFilterFactory(const json& securityConfig);
+    ~RateLimitFilterFactory() override = default;
+
+    void onServerStart(folly::EventBase* evb) noexcept override;
+    void onServerStop() noexcept override;
+    proxygen::RequestHandler* onRequest(proxygen::RequestHandler* handler,
+                                        proxygen::HTTPMessage* message) noexcept override;
+
+private:
+    // Null when rate limiting is disabled
+    std::unique_ptr<util::RateLimiter> limiter_;
+    size_t limitedCounter_ = util::Metrics::kInvalid;
+};
+
+} // namespace handlers
+} // namespace securapp
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace securapp {
+namespace handlers {
+
+// HTTP methods a route can be registered for
+enum class RouteMethod : uint8_t {
+    Get,
+    Post,
+    Put,
+    Patch,
+    Delete,
+    Head,
+    Options,
+    Any,    // matches every method without a more specific route
+    Count
+};
+
+// Parse a request method; unknown methods only match RouteMethod::Any
+std::optional<RouteMethod> parseRouteMethod(std::string_view method);
+
+// Upper-case name of a method, "*" for RouteMethod::Any
+const char* routeMethodName(RouteMethod method);
+
+// Path parameters captured by a route. Names and values are views into the
+// route table and the request path, so they stay valid as long as both do.
+class RouteParams {
+public:
+    static constexpr size_t kMaxParams = 8;
+
+    // Value of the {name} segment, empty if the route has none
+    std::string_view get(std::string_view name) const {
+        for (size_t i = 0; i < count_; i++) {
+            if (params_[i].first == name) {
+                return params_[i].second;
+            }
+        }
+        return std::string_view();
+    }
+
+    size_t size() const { return count_; }
+
+    void add(std::string_view name, std::string_view value) {
+        if (count_ < kMaxParams) {
+            params_[count_++] = {name, value};
+        }
+    }
+
+private:
+    std::array<std::pair<std::string_view, std::string_view>, kMaxParams> params_;
+    size_t count_ = 0;
+};
+
+// Routes keyed on method and path segments, stored as a trie that is built
+// once at startup. Matching walks the request path once without allocating;
+// literal segments take precedence over {param} captures. Empty segments
+// are ignored, so "/health/" matches "/health".
+template <typename T>
+class Router {
+public:
+    enum class Status { Found, NotFound, MethodNotAllowed };
+
+    struct Match {
+        Status status = Status::NotFound;
+        const T* value = nullptr;
+        RouteParams params;
+    };
+
+    Router() : nodes_(1) {}
+
+    // Register 'value' for 'pattern', e.g. "/api/users/{id}"
+    void add(RouteMethod method, std::string_view pattern, T value) {
+        uint32_t node = 0;
+        forEachSegment(pattern, [&](std::string_view segment) {
+            if (segment.size() > 2 && segment.front() == '{' && segment.back() == '}') {
+                std::string name(segment.substr(1, segment.size() - 2));
+                if (nodes_[node].param == 0) {
+                    uint32_t child = static_cast<uint32_t>(nodes_.size());
+                    nodes_.emplace_back();
+                    nodes_[node].param = child;
+                    nodes_[node].paramName = std::move(name);
+                }
+                node = nodes_[node].param;
+            } else {
+                uint32_t child = findChild(node, segment);
+                if (child == 0) {
+                    child = static_cast<uint32_t>(nodes_.size());
+                    nodes_.emplace_back();
+                    nodes_[node].children.emplace_back(std::string(segment), child);
+                }
+                node = child;
+            }
+            return true;
+        });
+        nodes_[node].values[static_cast<size_t>(method)] = std::move(value);
+    }
+
+    // Look up the route for a request
+    Match match(std::string_view method, std::string_view path) const {
+        Match result;
+        uint32_t node = 0;
+
+        bool found = forEachSegment(path, [&](std::string_view segment) {
+            uint32_t child = findChild(node, segment);
+            if (child == 0) {
+                child = nodes_[node].param;
+                if (child == 0) {
+                    return false;
+                }
+                result.params.add(nodes_[node].paramName, segment);
+            }
+            node = child;
+            return true;
+        });
+        if (!found) {
+            return result;
+        }
+
+        const Node& target = nodes_[node];
+        std::optional<RouteMethod> parsed = parseRouteMethod(method);
+        const std::optional<T>* value = nullptr;
+        if (parsed && target.values[static_cast<size_t>(*parsed)]) {
+            value = &target.values[static_cast<size_t>(*parsed)];
+        } else if (target.values[static_cast<size_t>(RouteMethod::Any)]) {
+            value = &target.values[static_cast<size_t>(RouteMethod::Any)];
+        }
+
+        if (value) {
+            result.status = Status::Found;
+            result.value = &**value;
+            return result;
+        }
+
+        for (const auto& candidate : target.values) {
+            if (candidate) {
+                result.status = Status::MethodNotAllowed;
+                break;
+            }
+        }
+        return result;
+    }
+
+private:
+    // A path position; node 0 is the root and never anyone's child
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> children;
+        uint32_t param = 0;
+        std::string paramName;
+        std::array<std::optional<T>, static_cast<size_t>(RouteMethod::Count)> values;
+    };
+
+    // Call 'fn' for each non-empty segment; stops and returns false as soon
+    // as 'fn' does
+    template <typename F>
+    static bool forEachSegment(std::string_view path, F&& fn) {
+        size_t pos = 0;
+        while (pos < path.size()) {
+            size_t end = path.find('/', pos);
+            if (end == std::string_view::npos) {
+                end = path.size();
+            }
+            if (end > pos && !fn(path.substr(pos, end - pos))) {
+                return false;
+            }
+            pos = end + 1;
+        }
+        return true;
+    }
+
+    // Literal child of 'node' for 'segment', 0 if there is none
+    uint32_t findChild(uint32_t node, std::string_view segment) const {
+        for (const auto& child : nodes_[node].children) {
+            if (child.first == segment) {
+                return child.second;
+            }
+        }
+        return 0;
+    }
+
+    std::vector<Node> nodes_;
+};
+
+} // namespace handlers
+} // namespace securapp
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "handlers/BaseHandler.h"
+
+namespace securapp {
+namespace handlers {
+
+// Lists the requests kept by util::SlowRequestLog with their phase
+// breakdown, newest first
+class SlowRequestsHandler : public BaseHandler {
+public:
+    SlowRequestsHandler() = default;
+    ~SlowRequestsHandler() override = default;
+
+protected:
+    void handleRequest() override;
+};
+
+} // namespace handlers
+} // namespace securapp
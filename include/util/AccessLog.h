@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace util {
+
+// One finished request, fixed size so recording it is a plain copy
+struct AccessRecord {
+    uint64_t timestampUs = 0;  // wall clock, microseconds since the epoch
+    uint32_t latencyUs = 0;
+    uint16_t status = 0;       // 0 if no response was sent
+    uint64_t bytesOut = 0;
+    char method[8] = {};
+    char path[104] = {};       // truncated, NUL-terminated
+};
+
+// Access log settings (the "logging" config section)
+struct AccessLogOptions {
+    bool enabled = true;
+    std::string file = "./logs/access.log";
+    // Fraction of successful requests recorded (access_log_sample_rate);
+    // errors and aborted requests are always recorded
+    double sampleRate = 1.0;
+    // Records buffered per IO thread before new ones are dropped
+    size_t bufferRecords = 4096;
+    std::chrono::milliseconds flushInterval{200};
+
+    static AccessLogOptions fromConfig(const json& loggingConfig);
+};
+
+// Request log kept off the event loops. Each IO thread writes fixed-size
+// records into its own lock-free ring; a background thread drains the
+// rings, formats the records and appends them to the file in batches.
+// When a ring is full the record is dropped and counted, so logging never
+// blocks a request.
+class AccessLog {
+public:
+    static AccessLog& getInstance();
+
+    // Open the file and start the flusher thread
+    bool start(const AccessLogOptions& options);
+
+    // Flush what is buffered and stop the flusher thread
+    void stop();
+
+    // Whether a request that ended with 'status' should be recorded
+    bool sampled(uint16_t status) const;
+
+    // Queue a record from the calling thread; never blocks
+    void record(const AccessRecord& record);
+
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    AccessLog() = default;
+    ~AccessLog();
+
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+
+    // Single-producer single-consumer ring owned by one IO thread
+    class Ring;
+
+    // Ring of the calling thread, created on first use
+    Ring* localRing();
+
+    void flushLoop();
+
+    // Append every buffered record to 'out'; returns the number of records
+    size_t drain(std::string& out);
+
+    std::atomic<bool> running_{false};
+    AccessLogOptions options_;
+    FILE* file_ = nullptr;
+
+    std::mutex ringsMutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread flusher_;
+
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace securapp {
+namespace util {
+
+// Monotonic allocator for short-lived per-request objects. Allocation bumps
+// a pointer; nothing is freed individually. reset() releases everything at
+// once and keeps the first block, so a reused arena stops touching malloc
+// once it has seen a typical request.
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 8192);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t(align) - 1);
+        if (p + size > reinterpret_cast<uintptr_t>(end_)) {
+            return allocateSlow(size, align);
+        }
+        cur_ = reinterpret_cast<char*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+
+    // The pointer lies in one of this arena's blocks
+    bool owns(const void* p) const;
+
+    // Release every allocation, keeping the first block
+    void reset();
+
+    // Bytes handed out since the last reset
+    size_t used() const;
+
+    // Arena that ArenaAllocator draws from on this thread, if any
+    static Arena* current() { return current_; }
+
+    // Makes an arena current for the calling thread until destroyed
+    class Scope {
+    public:
+        explicit Scope(Arena& arena) : previous_(current_) { current_ = &arena; }
+        ~Scope() { current_ = previous_; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena* previous_;
+    };
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    void* allocateSlow(size_t size, size_t align);
+
+    size_t blockSize_;
+    std::vector<Block> blocks_;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+
+    static thread_local Arena* current_;
+};
+
+// Stateless allocator over the current thread's arena, falling back to the
+// heap when no arena is current. Memory must be released under the same
+// arena (or lack of one) it was obtained under; BaseHandler keeps its arena
+// current in every callback, which covers values living within a request.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (Arena* arena = Arena::current()) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t /* n */) noexcept {
+        Arena* arena = Arena::current();
+        if (arena && arena->owns(p)) {
+            return;
+        }
+        ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>&) const noexcept { return false; }
+};
+
+// JSON value whose nodes (objects, arrays, string headers) live in the
+// current arena. String contents past the small-string buffer still come
+// from the heap, which keeps std::string interoperable. Converts to and
+// from json like any other nlohmann value.
+using ArenaJson = nlohmann::basic_json<std::map, std::vector, std::string, bool,
+                                       std::int64_t, std::uint64_t, double, ArenaAllocator>;
+
+} // namespace util
+} // namespace securapp
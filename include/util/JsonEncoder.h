@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <nlohmann/json.hpp>
+
+namespace securapp {
+namespace util {
+
+// Wire formats a JSON value can be sent in
+enum class Encoding {
+    Json,        // compact JSON (default)
+    PrettyJson,  // JSON indented by 2 spaces, for humans
+    MsgPack,     // application/msgpack
+    Cbor         // application/cbor
+};
+
+// Content-Type header value for an encoding
+const char* contentType(Encoding encoding);
+
+// Pick the encoding from an Accept header. Binary formats must be asked for
+// explicitly; anything else gets compact JSON.
+Encoding encodingForAccept(std::string_view accept);
+
+// std::streambuf whose put area is the tailroom of an IOBuf chain, so
+// nlohmann serializers write straight into the response buffers
+class IOBufStreamBuf : public std::streambuf {
+public:
+    // 'sizeHint' sizes the first buffer, 'growth' each one after it
+    explicit IOBufStreamBuf(size_t sizeHint = 1024, size_t growth = 16384);
+
+    // Take the written bytes; the buffer can be written again afterwards
+    std::unique_ptr<folly::IOBuf> finish();
+
+protected:
+    int_type overflow(int_type c) override;
+
+private:
+    // Hand the bytes written so far to the queue
+    void commit();
+
+    folly::IOBufQueue queue_{folly::IOBufQueue::cacheChainLength()};
+    size_t nextSize_;
+    size_t growth_;
+};
+
+// Serialize any nlohmann value (json, ArenaJson) into an IOBuf chain
+template <typename BasicJson>
+std::unique_ptr<folly::IOBuf> encode(const BasicJson& value, Encoding encoding, size_t sizeHint = 1024) {
+    IOBufStreamBuf buf(sizeHint);
+    std::ostream out(&buf);
+
+    switch (encoding) {
+        case Encoding::MsgPack:
+            BasicJson::to_msgpack(value, out);
+            break;
+        case Encoding::Cbor:
+            BasicJson::to_cbor(value, out);
+            break;
+        case Encoding::PrettyJson:
+            out << std::setw(2) << value;
+            break;
+        default:
+            out << value;
+            break;
+    }
+    return buf.finish();
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "util/Arena.h"
+
+namespace securapp {
+namespace util {
+
+// Resumable JSON parser fed one chunk at a time, e.g. straight from
+// onBody(). Input is validated as it arrives, so malformed documents are
+// rejected before the upload finishes, and the value is built incrementally.
+// With a field list, only those members of a top-level object are kept;
+// everything else is validated and dropped without building a DOM for it.
+// The value is an ArenaJson, so the caller's arena must stay current while
+// feeding and for as long as the parser or its result lives.
+class JsonStreamParser {
+public:
+    // 'fields' restricts the top-level object members that are kept (empty
+    // keeps everything); 'maxDepth' bounds container nesting
+    explicit JsonStreamParser(std::vector<std::string> fields = {}, size_t maxDepth = 64);
+
+    // Parse the next chunk. Returns false once the input is malformed.
+    bool feed(const char* data, size_t length);
+
+    // The input is complete. Returns false if the document is unfinished.
+    bool finish();
+
+    // Parsed value, valid after finish() returned true
+    ArenaJson release() { return std::move(root_); }
+
+    // Description of the first error
+    const std::string& error() const { return error_; }
+
+    bool failed() const { return state_ == State::Error; }
+
+private:
+    enum class State {
+        Value,        // expecting any value
+        ArrayFirst,   // after '[': a value or ']'
+        ObjectFirst,  // after '{': a key or '}'
+        Key,          // after ',' in an object: a key
+        Colon,        // after a key
+        Comma,        // after a value: ',' or the closing bracket
+        String,       // inside a string (key or value)
+        Number,       // inside a number
+        Literal,      // inside true / false / null
+        Done,         // complete document, only whitespace may follow
+        Error
+    };
+
+    // Progress through an escape sequence inside a string
+    enum class Escape { None, Start, Hex, LowBackslash, LowU };
+
+    // An open array or object
+    struct Frame {
+        ArenaJson* target;   // container being filled, nullptr if skipped
+        bool object;
+        std::string key;     // key of the member being parsed
+        bool keep;           // whether the value being parsed is kept
+    };
+
+    // Per-state handlers; return the number of bytes consumed (0 means the
+    // byte must be looked at again in the new state)
+    size_t scanString(const char* data, size_t length);
+    size_t scanNumber(const char* data, size_t length);
+    bool structural(char c);
+
+    void beginValue(char c);
+    void beginString(bool key);
+    void openContainer(bool object);
+    void closeContainer(bool object);
+    void completeString();
+    void completeNumber();
+    void emit(ArenaJson&& value);
+
+    // Whether the value about to be parsed is kept
+    bool keepingValue() const { return stack_.empty() || stack_.back().keep; }
+
+    bool escapeChar(unsigned char c);
+    bool utf8Byte(unsigned char c);
+    void appendCodePoint(uint32_t codePoint);
+
+    bool fail(const std::string& message);
+
+    std::unordered_set<std::string> fields_;
+    size_t maxDepth_;
+
+    State state_ = State::Value;
+    std::vector<Frame> stack_;
+    ArenaJson root_;
+    std::string error_;
+
+    // Token in progress (string contents, number text)
+    std::string token_;
+    bool stringIsKey_ = false;
+    // Whether the string being scanned is kept (skipped values are only
+    // validated)
+    bool collecting_ = false;
+
+    // Escape and UTF-8 decoding state
+    Escape escape_ = Escape::None;
+    int hexLeft_ = 0;
+    uint32_t codeUnit_ = 0;
+    uint32_t highSurrogate_ = 0;
+    int utf8Left_ = 0;
+    unsigned char utf8Low_ = 0x80;
+    unsigned char utf8High_ = 0xBF;
+
+    // Literal being matched
+    const char* literal_ = nullptr;
+    size_t literalPos_ = 0;
+};
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <nlohmann/json.hpp>
+#include "util/Arena.h"
+
+#ifdef SECURAPP_HAVE_SIMDJSON
+#include <simdjson.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace util {
+
+// Read-only access to the members of a parsed JSON object, backed either by
+// an nlohmann value or, when built with simdjson, by a simdjson DOM element.
+// Values are read in place; nothing is converted until asked for. The view
+// does not own the document and must not outlive it.
+class JsonView {
+public:
+    JsonView() = default;
+    explicit JsonView(const ArenaJson* value) : value_(value) {}
+#ifdef SECURAPP_HAVE_SIMDJSON
+    explicit JsonView(simdjson::dom::element element) : element_(element), simd_(true) {}
+#endif
+
+    // A document is attached
+    bool valid() const;
+
+    bool isObject() const;
+
+    // The object has a member named 'key'
+    bool contains(std::string_view key) const;
+
+    // Member values; nullopt if missing or of another type
+    std::optional<std::string_view> getString(std::string_view key) const;
+    std::optional<int64_t> getInt(std::string_view key) const;
+    std::optional<bool> getBool(std::string_view key) const;
+
+    // Materialize the whole document, for code that needs a DOM
+    json toJson() const;
+
+private:
+    const ArenaJson* value_ = nullptr;
+#ifdef SECURAPP_HAVE_SIMDJSON
+    simdjson::dom::element element_;
+    bool simd_ = false;
+#endif
+};
+
+#ifdef SECURAPP_HAVE_SIMDJSON
+// Parses with the calling thread's simdjson parser. 'data' must be followed
+// by at least simdjson::SIMDJSON_PADDING readable bytes. The returned view
+// stays valid until the next parse on the same thread.
+bool parseSimdJson(const uint8_t* data, size_t length, JsonView& view, std::string& error);
+#endif
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sodium.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace util {
+
+// JWT settings (the "security" config section)
+struct JwtOptions {
+    // HMAC key (jwt_secret)
+    std::string secret;
+    // Lifetime of issued tokens (jwt_expiration)
+    std::chrono::seconds lifetime{3600};
+    // Also refuse tokens revoked in user_tokens (jwt_check_revocation).
+    // Each token is looked up once per token cache TTL; without the check
+    // verification never touches the database.
+    bool checkRevocation = true;
+
+    static JwtOptions fromConfig(const json& securityConfig);
+};
+
+// Claims of a token this server issued
+struct JwtClaims {
+    int64_t userId = 0;  // "sub"
+    int64_t issuedAt = 0;   // "iat", seconds since the epoch
+    int64_t expiresAt = 0;  // "exp", seconds since the epoch
+};
+
+// Issues and verifies HS256 tokens. The HMAC key schedule is computed once
+// and copied for each signature. Verification decodes into stack buffers
+// and allocates nothing. Each thread remembers the tokens it recently
+// verified, so a client's repeated requests skip the HMAC as well.
+class Jwt {
+public:
+    static Jwt& getInstance();
+
+    // Longest token accepted; longer ones fail verification
+    static constexpr size_t kMaxTokenLength = 512;
+
+    // Set the key; false if there is none. Call before the server starts.
+    bool configure(const JwtOptions& options);
+
+    const JwtOptions& options() const { return options_; }
+
+    // Signed token for 'userId', valid for the configured lifetime
+    std::string issue(int64_t userId) const;
+
+    // Check the signature and expiry of 'token' and read its claims
+    bool verify(std::string_view token, JwtClaims& claims) const;
+
+private:
+    Jwt() = default;
+
+    Jwt(const Jwt&) = delete;
+    Jwt& operator=(const Jwt&) = delete;
+
+    // HMAC-SHA256 of 'data' with the configured key
+    void sign(std::string_view data, unsigned char* mac) const;
+
+    // Signature and claims check without the per-thread cache
+    bool verifySlow(std::string_view token, JwtClaims& claims) const;
+
+    JwtOptions options_;
+    // HMAC state with the key already absorbed
+    crypto_auth_hmacsha256_state keyed_;
+    // Encoded {"alg":"HS256","typ":"JWT"}; the only header accepted
+    std::string header_;
+};
+
+} // namespace util
+} // namespace securapp
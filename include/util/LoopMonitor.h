@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace util {
+
+// Loop monitoring settings (the "loop_monitor" object of the server config)
+struct LoopMonitorOptions {
+    bool enabled = true;
+    // How often each loop's probe timer fires
+    std::chrono::milliseconds interval{100};
+    // A loop that has not run its probe for this long is reported as blocked
+    std::chrono::milliseconds stallThreshold{500};
+
+    static LoopMonitorOptions fromConfig(const json& monitorConfig);
+};
+
+// Watches the IO event loops. Every loop runs a probe timer that records
+// how late it fired (the loop lag) into a histogram. A watchdog thread
+// checks the probes' heartbeats; when a loop has been stuck longer than the
+// threshold it logs the route being handled on that loop and a stack trace
+// of the blocked thread, captured with a signal.
+class LoopMonitor {
+public:
+    static LoopMonitor& getInstance();
+
+    // Start the watchdog thread
+    void start(const LoopMonitorOptions& options);
+    void stop();
+
+    // Install the probe on 'evb'; must be called on the loop's thread
+    void attach(folly::EventBase* evb);
+
+    // Remove the probe of the calling thread's loop
+    void detach();
+
+    // Marks what the calling loop thread is working on (e.g. a route) for
+    // stall reports. 'label' must outlive the scope.
+    class Activity {
+    public:
+        explicit Activity(const char* label);
+        ~Activity();
+
+        Activity(const Activity&) = delete;
+        Activity& operator=(const Activity&) = delete;
+
+    private:
+        std::atomic<const char*>* slot_;
+        const char* previous_ = nullptr;
+    };
+
+private:
+    LoopMonitor() = default;
+    ~LoopMonitor();
+
+    LoopMonitor(const LoopMonitor&) = delete;
+    LoopMonitor& operator=(const LoopMonitor&) = delete;
+
+    static constexpr int kMaxFrames = 48;
+
+    // State shared between a loop thread, its probe and the watchdog
+    struct LoopState {
+        size_t index = 0;
+        pthread_t thread;
+        size_t lagHistogram = 0;
+        // steady_clock microseconds of the last probe run
+        std::atomic<int64_t> lastBeatUs{0};
+        std::atomic<const char*> activity{nullptr};
+        // Heartbeat value of the stall already reported
+        int64_t reportedBeatUs = 0;
+        std::atomic<bool> active{true};
+
+        // Stack capture: the watchdog sets 1, the signal handler fills the
+        // frames and sets 2
+        std::atomic<int> traceState{0};
+        void* frames[kMaxFrames];
+        int frameCount = 0;
+    };
+
+    class Probe;
+
+    void watchLoop();
+    void reportStall(LoopState& state, int64_t stalledUs);
+
+    static void onTraceSignal(int signum);
+
+    static thread_local LoopState* localState_;
+    static thread_local Probe* localProbe_;
+
+    LoopMonitorOptions options_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<LoopState>> loops_;
+    size_t stallCounter_ = 0;
+
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread watchdog_;
+    bool running_ = false;
+};
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <folly/io/async/EventBase.h>
+
+namespace securapp {
+namespace util {
+
+// Samples every iteration of an event loop into the metrics: how long the
+// loop was busy running callbacks and how many iterations it made.
+// Installed on each IO thread's EventBase; runs on that thread.
+class LoopObserver : public folly::EventBaseObserver {
+public:
+    LoopObserver();
+
+    uint32_t getSampleRate() const override { return 1; }
+    void loopSample(int64_t busyTime, int64_t idleTime) override;
+
+private:
+    size_t busyHistogram_;
+    size_t iterations_;
+    size_t idleMicros_;
+};
+
+} // namespace util
+} // namespace securapp
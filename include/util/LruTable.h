@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace securapp {
+namespace util {
+
+// Fixed-capacity table of values keyed by a 64-bit hash. Inserting into a
+// full table reuses the slot of the least recently used entry, so memory
+// never grows past the capacity. Not thread safe; callers shard and lock.
+template <typename V>
+class LruTable {
+public:
+    explicit LruTable(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+    // Value for 'key', made most recently used; nullptr if absent
+    V* find(uint64_t key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return nullptr;
+        }
+        touch(it->second);
+        return &slots_[it->second].value;
+    }
+
+    // Value for 'key'. A missing key gets a slot, evicting the least
+    // recently used entry if the table is full; 'inserted' says so, and the
+    // caller must then set every field, as the slot keeps its old contents
+    // (so buffers are reused rather than reallocated).
+    V& findOrInsert(uint64_t key, bool& inserted) {
+        if (V* value = find(key)) {
+            inserted = false;
+            return *value;
+        }
+
+        uint32_t slot;
+        if (!free_.empty()) {
+            slot = free_.back();
+            free_.pop_back();
+        } else if (slots_.size() < capacity_) {
+            slot = static_cast<uint32_t>(slots_.size());
+            slots_.emplace_back();
+        } else {
+            slot = tail_;
+            unlink(slot);
+            index_.erase(slots_[slot].key);
+        }
+
+        Slot& entry = slots_[slot];
+        entry.key = key;
+        index_.emplace(key, slot);
+        pushFront(slot);
+        inserted = true;
+        return entry.value;
+    }
+
+    // Drop 'key'; false if it was not there
+    bool erase(uint64_t key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return false;
+        }
+        uint32_t slot = it->second;
+        index_.erase(it);
+        unlink(slot);
+        slots_[slot].value = V();
+        free_.push_back(slot);
+        return true;
+    }
+
+    // Least recently used value and its key, nullptr if the table is empty.
+    // Does not count as a use; pass the key to erase() to evict it.
+    V* oldest(uint64_t& key) {
+        if (tail_ == kNone) {
+            return nullptr;
+        }
+        key = slots_[tail_].key;
+        return &slots_[tail_].value;
+    }
+
+    size_t size() const { return index_.size(); }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Slot {
+        uint64_t key = 0;
+        V value;
+        // LRU neighbours, kNone at the ends
+        uint32_t prev = kNone;
+        uint32_t next = kNone;
+    };
+
+    void touch(uint32_t slot) {
+        if (head_ != slot) {
+            unlink(slot);
+            pushFront(slot);
+        }
+    }
+
+    void unlink(uint32_t slot) {
+        Slot& entry = slots_[slot];
+        if (entry.prev != kNone) {
+            slots_[entry.prev].next = entry.next;
+        } else {
+            head_ = entry.next;
+        }
+        if (entry.next != kNone) {
+            slots_[entry.next].prev = entry.prev;
+        } else {
+            tail_ = entry.prev;
+        }
+        entry.prev = kNone;
+        entry.next = kNone;
+    }
+
+    void pushFront(uint32_t slot) {
+        Slot& entry = slots_[slot];
+        entry.prev = kNone;
+        entry.next = head_;
+        if (head_ != kNone) {
+            slots_[head_].prev = slot;
+        }
+        head_ = slot;
+        if (tail_ == kNone) {
+            tail_ = slot;
+        }
+    }
+
+    size_t capacity_;
+    std::unordered_map<uint64_t, uint32_t> index_;
+    std::vector<Slot> slots_;
+    // Slots released by erase()
+    std::vector<uint32_t> free_;
+    uint32_t head_ = kNone;  // most recently used
+    uint32_t tail_ = kNone;  // next to evict
+};
+
+} // namespace util
+} // namespace securapp
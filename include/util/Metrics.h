@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace securapp {
+namespace util {
+
+// Log-linear latency histogram in the style of HdrHistogram: each power of
+// two is split into kSubBuckets linear buckets, so any recorded value is
+// off by at most 1/kSubBuckets. Values are microseconds.
+struct HistogramLayout {
+    static constexpr int kSubBucketBits = 3;
+    static constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+    // Values up to 2^kMaxExponent us (about 19 hours) are told apart
+    static constexpr int kMaxExponent = 36;
+    static constexpr size_t kBuckets = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+    static size_t bucketFor(uint64_t value);
+
+    // Smallest value that no longer falls into 'bucket'
+    static uint64_t upperBound(size_t bucket);
+};
+
+// Process-wide counters and histograms. Each thread records into its own
+// shard with plain relaxed stores, so the hot path takes no lock and
+// shares no cache line with other threads; shards are only summed when
+// the metrics are scraped. Series are registered once (usually at startup)
+// and addressed by the returned id.
+class Metrics {
+public:
+    static constexpr size_t kMaxCounters = 512;
+    static constexpr size_t kMaxHistograms = 256;
+
+    static Metrics& getInstance();
+
+    // Register a series; the same name and labels return the same id.
+    // 'labels' is the Prometheus label list without braces, e.g.
+    // route="/health",status="2xx". Returns kInvalid once full.
+    size_t counter(const std::string& name, const std::string& labels, const std::string& help);
+    size_t histogram(const std::string& name, const std::string& labels, const std::string& help);
+
+    static constexpr size_t kInvalid = static_cast<size_t>(-1);
+
+    // Hot path, from any thread
+    void add(size_t counterId, uint64_t delta = 1);
+    void observe(size_t histogramId, uint64_t micros);
+
+    // Append all series in the Prometheus text format (version 0.0.4).
+    // Histograms are exported with fixed buckets from 100us to 10s.
+    void render(std::string& out) const;
+
+    // Append quantiles of every 'histogramName' series as the gauge family
+    // 'name', one series per quantile label
+    void renderQuantiles(std::string& out, const std::string& histogramName,
+                         const std::string& name, const std::string& help,
+                         const std::vector<double>& quantiles) const;
+
+    // Append a single value that is computed at scrape time
+    static void writeValue(std::string& out, const std::string& name, const char* type,
+                           const std::string& help, double value);
+
+private:
+    Metrics() = default;
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    struct HistogramCells {
+        std::array<std::atomic<uint64_t>, HistogramLayout::kBuckets> buckets{};
+        std::atomic<uint64_t> sum{0};
+    };
+
+    // Everything one thread records. Only the owning thread writes.
+    struct Shard {
+        std::array<std::atomic<uint64_t>, kMaxCounters> counters{};
+        // Created by the owning thread on first use
+        std::array<std::atomic<HistogramCells*>, kMaxHistograms> histograms{};
+
+        ~Shard();
+    };
+
+    struct Series {
+        std::string name;
+        std::string labels;
+        std::string help;
+    };
+
+    Shard& localShard();
+
+    // Sum of a histogram's buckets over all shards; returns the sample sum
+    uint64_t merge(size_t id, std::array<uint64_t, HistogramLayout::kBuckets>& buckets) const;
+
+    size_t registerSeries(std::vector<Series>& series, size_t limit,
+                          const std::string& name, const std::string& labels,
+                          const std::string& help);
+
+    mutable std::mutex mutex_;
+    std::vector<Series> counters_;
+    std::vector<Series> histograms_;
+    std::map<std::string, size_t> ids_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+// Request latency of one route, with a histogram per status class
+class RouteMetrics {
+public:
+    RouteMetrics() = default;
+    RouteMetrics(const std::string& method, const std::string& route);
+
+    // 'status' 0 means the request ended without a response
+    void record(uint16_t status, uint64_t micros) const;
+
+    // "METHOD /pattern", for diagnostics
+    const char* name() const { return name_.c_str(); }
+
+private:
+    std::string name_;
+    // aborted, 1xx .. 5xx
+    std::array<size_t, 6> histograms_{};
+};
+
+} // namespace util
+} // namespace securapp
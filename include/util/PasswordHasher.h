@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/futures/Future.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace util {
+
+// Password hashing settings (the "security" config section)
+struct PasswordHashOptions {
+    // bcrypt work factor (bcrypt_cost); each step doubles the time per hash
+    unsigned cost = 12;
+    // Threads doing nothing but hashing (hash_threads); 0 picks half the cores
+    size_t threads = 0;
+    // Hashes waiting for a thread before new ones are refused (hash_queue_limit)
+    size_t maxQueued = 64;
+
+    static PasswordHashOptions fromConfig(const json& securityConfig);
+};
+
+// A hash was refused because the pool is saturated; answer 503
+class HashingOverloaded : public std::runtime_error {
+public:
+    HashingOverloaded() : std::runtime_error("Password hashing is overloaded") {}
+};
+
+// bcrypt hashing and verification on a dedicated CPU pool. A hash takes
+// hundreds of milliseconds by design, which must never be spent on an IO
+// thread. Work beyond the threads plus the queue limit is refused right
+// away with HashingOverloaded instead of piling up.
+class PasswordHasher {
+public:
+    static PasswordHasher& getInstance();
+
+    bool start(const PasswordHashOptions& options);
+
+    // Finish queued work and join the threads
+    void stop();
+
+    // bcrypt hash of 'password' with a fresh salt
+    folly::SemiFuture<std::string> hash(std::string password);
+
+    // Whether 'password' matches 'storedHash'. An empty 'storedHash' is
+    // checked against a dummy hash, so unknown users take as long as
+    // wrong passwords.
+    folly::SemiFuture<bool> verify(std::string password, std::string storedHash);
+
+    // bcrypt only uses the first 72 bytes of a password
+    static constexpr size_t kMaxPasswordLength = 72;
+
+    size_t inFlight() const { return inFlight_.load(std::memory_order_relaxed); }
+
+private:
+    PasswordHasher() = default;
+    ~PasswordHasher();
+
+    PasswordHasher(const PasswordHasher&) = delete;
+    PasswordHasher& operator=(const PasswordHasher&) = delete;
+
+    // Reserve a slot for one job; false when saturated
+    bool admit();
+
+    // Run on a pool thread
+    std::string hashNow(const std::string& password) const;
+    bool verifyNow(const std::string& password, const std::string& storedHash) const;
+
+    PasswordHashOptions options_;
+    std::unique_ptr<folly::CPUThreadPoolExecutor> executor_;
+    size_t capacity_ = 0;
+    std::atomic<size_t> inFlight_{0};
+    // Compared against when the user does not exist
+    std::string dummyHash_;
+};
+
+} // namespace util
+} // namespace securapp
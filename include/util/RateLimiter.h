@@ -0,0 +1,71 @@
+#pragma once
+
+#include "util/LruTable.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace util {
+
+// Rate limit settings (the "rate_limit" object of the security config)
+struct RateLimitOptions {
+    bool enabled = true;
+    // Sustained rate allowed per client
+    uint32_t requestsPerMinute = 60;
+    // Requests a client may make at once after being idle; defaults to
+    // requests_per_minute
+    uint32_t burst = 0;
+    // Clients tracked at most; the least recently seen are forgotten first
+    size_t maxClients = 100000;
+
+    static RateLimitOptions fromConfig(const json& rateLimitConfig);
+};
+
+// Token buckets keyed by client. Keys are hashed to one of a fixed number
+// of shards, each with its own lock and a bounded LRU table, so threads
+// checking different clients rarely contend and memory stays capped no
+// matter how many clients show up.
+class RateLimiter {
+public:
+    explicit RateLimiter(const RateLimitOptions& options);
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // Take a token for 'key'. When none is left returns false and sets
+    // 'retryAfter' to the time until the next one.
+    bool allow(std::string_view key, std::chrono::seconds& retryAfter);
+
+    // Clients currently tracked
+    size_t size() const;
+
+private:
+    static constexpr size_t kShards = 64;
+
+    struct Bucket {
+        double tokens = 0;
+        int64_t updatedUs = 0;
+    };
+
+    // Buckets of the keys hashed to one shard
+    struct alignas(64) Shard {
+        explicit Shard(size_t capacity) : buckets(capacity) {}
+
+        mutable std::mutex mutex;
+        LruTable<Bucket> buckets;
+    };
+
+    double tokensPerUs_;
+    double burst_;
+    std::array<std::unique_ptr<Shard>, kShards> shards_;
+};
+
+} // namespace util
+} // namespace securapp
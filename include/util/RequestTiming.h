@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace securapp {
+namespace util {
+
+// Phases of a request, in the order they normally happen
+enum class Phase : uint8_t {
+    Route,      // matching the path and creating the handler
+    Body,       // receiving the request body
+    Parse,      // parsing the JSON body
+    DbWait,     // waiting for a database connection
+    Db,         // running statements
+    Serialize,  // encoding the response body
+    Send,       // from handing the response to proxygen until it completed
+    Count
+};
+
+constexpr size_t kPhaseCount = static_cast<size_t>(Phase::Count);
+
+// Short name used in Server-Timing and the slow request log
+const char* phaseName(Phase phase);
+
+// Time spent in each phase of one request. Phases that repeat (several
+// queries) accumulate. Fixed size, so a handler keeps one per request
+// without allocating.
+class RequestTiming {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void add(Phase phase, Clock::duration duration) {
+        spent_[static_cast<size_t>(phase)] += duration;
+    }
+
+    // Add the time since 'since' to 'phase'; returns the current time so
+    // consecutive phases can be chained
+    Clock::time_point addSince(Phase phase, Clock::time_point since) {
+        Clock::time_point now = Clock::now();
+        add(phase, now - since);
+        return now;
+    }
+
+    Clock::duration spent(Phase phase) const { return spent_[static_cast<size_t>(phase)]; }
+
+    uint64_t micros(Phase phase) const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(spent(phase)).count();
+    }
+
+    void clear() { spent_.fill(Clock::duration::zero()); }
+
+    // Server-Timing header value: every phase that took time so far, in
+    // milliseconds, followed by "total" for 'total'
+    std::string serverTiming(Clock::duration total) const;
+
+private:
+    std::array<Clock::duration, kPhaseCount> spent_{};
+};
+
+} // namespace util
+} // namespace securapp
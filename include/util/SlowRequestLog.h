@@ -0,0 +1,80 @@
+#pragma once
+
+#include "util/RequestTiming.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace util {
+
+// A request that took longer than the slow request threshold
+struct SlowRequest {
+    uint64_t timestampUs = 0;  // wall clock, microseconds since the epoch
+    uint64_t latencyUs = 0;
+    uint16_t status = 0;       // 0 if no response was sent
+    char method[8] = {};
+    char path[104] = {};       // truncated, NUL-terminated
+    std::array<uint64_t, kPhaseCount> phaseUs{};
+};
+
+// Slow request settings (the "slow_requests" object of the server config)
+struct SlowRequestOptions {
+    bool enabled = true;
+    // Requests taking at least this long are kept
+    std::chrono::milliseconds threshold{250};
+    // How many of the most recent slow requests are kept
+    size_t capacity = 64;
+
+    static SlowRequestOptions fromConfig(const json& slowConfig);
+};
+
+// Ring of the most recent requests slower than the threshold, with their
+// phase breakdown, for the /debug/slow-requests endpoint. Fast requests
+// only pay for a comparison; the lock is taken for slow ones.
+class SlowRequestLog {
+public:
+    static SlowRequestLog& getInstance();
+
+    void configure(const SlowRequestOptions& options);
+
+    // Whether a request that took 'latencyUs' should be recorded
+    bool isSlow(uint64_t latencyUs) const {
+        return latencyUs >= thresholdUs_.load(std::memory_order_relaxed);
+    }
+
+    void record(const SlowRequest& request);
+
+    // Kept requests, newest first
+    std::vector<SlowRequest> snapshot() const;
+
+    std::chrono::milliseconds threshold() const;
+
+    // Slow requests seen since startup, including those overwritten
+    uint64_t recorded() const { return recorded_.load(std::memory_order_relaxed); }
+
+private:
+    SlowRequestLog() = default;
+
+    SlowRequestLog(const SlowRequestLog&) = delete;
+    SlowRequestLog& operator=(const SlowRequestLog&) = delete;
+
+    // UINT64_MAX while disabled or not configured
+    std::atomic<uint64_t> thresholdUs_{UINT64_MAX};
+    std::atomic<uint64_t> recorded_{0};
+
+    mutable std::mutex mutex_;
+    std::vector<SlowRequest> ring_;
+    size_t capacity_ = 0;
+    // Slot the next record goes to once the ring is full
+    size_t next_ = 0;
+};
+
+} // namespace util
+} // namespace securapp
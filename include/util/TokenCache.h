@@ -0,0 +1,92 @@
+#pragma once
+
+#include "util/LruTable.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace securapp {
+namespace util {
+
+// Token cache settings (the "token_cache" object of the security config)
+struct TokenCacheOptions {
+    // Tokens remembered at most; the least recently used are forgotten
+    size_t maxEntries = 100000;
+    // How long a valid token is trusted without asking the database again.
+    // Revocations made by other server instances take up to this long to
+    // be seen here; local ones are seen immediately.
+    std::chrono::milliseconds ttl{30000};
+    // How long an unknown, expired or revoked token is remembered as such
+    std::chrono::milliseconds negativeTtl{5000};
+
+    static TokenCacheOptions fromConfig(const json& cacheConfig);
+};
+
+// What is known about a bearer token
+struct TokenInfo {
+    bool valid = false;
+    int64_t userId = 0;
+    std::chrono::system_clock::time_point expiresAt;
+};
+
+// Outcomes of token checks, valid and invalid, so repeated checks skip the
+// database. Entries are spread over shards by hash, each with its own lock
+// and a bounded LRU table; a hit is a hash, a short critical section and a
+// string compare. Valid entries never outlive the token's expiry.
+class TokenCache {
+public:
+    explicit TokenCache(const TokenCacheOptions& options);
+
+    TokenCache(const TokenCache&) = delete;
+    TokenCache& operator=(const TokenCache&) = delete;
+
+    // Cached answer for 'token', nullopt if unknown or stale
+    std::optional<TokenInfo> lookup(std::string_view token);
+
+    void storeValid(std::string_view token, int64_t userId,
+                    std::chrono::system_clock::time_point expiresAt);
+    void storeInvalid(std::string_view token);
+
+    // Refuse 'token' until 'expiresAt', for tokens that would otherwise
+    // still verify on their own
+    void storeRevoked(std::string_view token, std::chrono::system_clock::time_point expiresAt);
+
+    size_t size() const;
+
+private:
+    static constexpr size_t kShards = 64;
+
+    struct Entry {
+        std::string token;  // the full token; hashes can collide
+        TokenInfo info;
+        std::chrono::steady_clock::time_point until;
+    };
+
+    struct alignas(64) Shard {
+        explicit Shard(size_t capacity) : entries(capacity) {}
+
+        mutable std::mutex mutex;
+        LruTable<Entry> entries;
+    };
+
+    Shard& shardFor(uint64_t hash) { return *shards_[(hash >> 32) % kShards]; }
+
+    void store(std::string_view token, const TokenInfo& info,
+               std::chrono::steady_clock::time_point until);
+
+    TokenCacheOptions options_;
+    std::array<std::unique_ptr<Shard>, kShards> shards_;
+    size_t hitCounter_;
+    size_t missCounter_;
+};
+
+} // namespace util
+} // namespace securapp
@@ -1,6 +1,16 @@
 #include "ServerApp.h"
 #include "handlers/HandlerFactory.h"
+#include "handlers/ApiHandler.h"
+#include "handlers/HealthCheckHandler.h"
+#include "handlers/RateLimitFilter.h"
+#include "db/AuditLog.h"
 #include "db/DatabaseManager.h"
+#include "db/TokenStore.h"
+#include "util/AccessLog.h"
+#include "util/Jwt.h"
+#include "util/LoopMonitor.h"
+#include "util/PasswordHasher.h"
+#include "util/SlowRequestLog.h"
 
 #include <glog/logging.h>
 #include <folly/json.h>
@@ -13,6 +23,7 @@
 #include <proxygen/httpserver/Filters.h>
 
 #include <signal.h>
+#include <sodium.h>
 #include <fstream>
 #include <thread>
 
@@ -73,9 +84,39 @@ bool ServerApp::initialize(const std::string& configPath) {
         return false;
     }
 
+    // Request logging is written by a background thread
+    if (!util::AccessLog::getInstance().start(
+            util::AccessLogOptions::fromConfig(config_.value("logging", json::object())))) {
+        return false;
+    }
+
+    // Token signing and ids use libsodium
+    if (sodium_init() < 0) {
+        LOG(ERROR) << "Failed to initialize libsodium";
+        return false;
+    }
+    if (!util::Jwt::getInstance().configure(
+            util::JwtOptions::fromConfig(config_.value("security", json::object())))) {
+        return false;
+    }
+
+    // bcrypt runs on its own threads, never on the IO threads
+    if (!util::PasswordHasher::getInstance().start(
+            util::PasswordHashOptions::fromConfig(config_.value("security", json::object())))) {
+        return false;
+    }
+    db::TokenStore::getInstance().configure(util::TokenCacheOptions::fromConfig(
+        config_.value("security", json::object()).value("token_cache", json::object())));
+
     // Get server config
     const auto& serverConfig = config_["server"];
 
+    // Watchdog for blocked event loops; probes attach as IO threads start
+    util::LoopMonitor::getInstance().start(
+        util::LoopMonitorOptions::fromConfig(serverConfig.value("loop_monitor", json::object())));
+    util::SlowRequestLog::getInstance().configure(
+        util::SlowRequestOptions::fromConfig(serverConfig.value("slow_requests", json::object())));
+
     // Setup HTTP server options
     proxygen::HTTPServerOptions options;
     options.threads = serverConfig.value("threads", 4);
@@ -83,8 +124,11 @@ bool ServerApp::initialize(const std::string& configPath) {
     options.shutdownOn = {SIGINT, SIGTERM};
     options.enableContentCompression = true;
 
-    // Setup handler factory
+    // Setup handler factories, once for HTTP and HTTPS alike. The rate
+    // limiter is given the handler HandlerFactory routed the request to.
     options.handlerFactories = proxygen::RequestHandlerChain()
+        .addThen(std::make_unique<handlers::RateLimitFilterFactory>(
+            config_.value("security", json::object())))
         .addThen(std::make_unique<handlers::HandlerFactory>(config_))
         .build();
 
@@ -151,6 +195,18 @@ bool ServerApp::initDatabase() {
             return false;
         }
 
+        // Statements are prepared lazily per connection on first use
+        handlers::HealthCheckHandler::registerStatements();
+        handlers::ApiHandler::registerStatements();
+        db::TokenStore::registerStatements();
+
+        // Every cached statement is known now; start hearing about changes
+        db::DatabaseManager::getInstance().startResultCache();
+
+        // Security events are written to audit_log in batches
+        db::AuditLog::getInstance().start(db::AuditLogOptions::fromConfig(
+            config_.value("logging", json::object()).value("audit", json::object())));
+
         LOG(INFO) << "Database connection established";
         return true;
     } catch (const std::exception& e) {
@@ -199,9 +255,6 @@ bool ServerApp::setupSSL(proxygen::HTTPServerOptions& options) {
 
         // Set the SSL context for HTTPS
         options.enableContentCompression = false;
-        options.handlerFactories = proxygen::RequestHandlerChain()
-            .addThen(std::make_unique<handlers::HandlerFactory>(config_))
-            .build();
 
         LOG(INFO) << "SSL configured successfully";
         return true;
@@ -231,9 +284,17 @@ void ServerApp::stop() {
         server_->stop();
         running_ = false;
 
+        // Queued audit events still need the database
+        db::AuditLog::getInstance().stop();
+
         // Close database connection
         db::DatabaseManager::getInstance().close();
 
+        // Write out the remaining access log records
+        util::AccessLog::getInstance().stop();
+        util::LoopMonitor::getInstance().stop();
+        util::PasswordHasher::getInstance().stop();
+
         LOG(INFO) << "Server stopped";
     }
 }
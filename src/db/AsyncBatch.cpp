@@ -0,0 +1,68 @@
+#include "db/AsyncBatch.h"
+#include <glog/logging.h>
+
+namespace securapp {
+namespace db {
+
+folly::SemiFuture<std::vector<BatchResult>> AsyncBatch::start(
+    folly::EventBase* evb,
+    PooledConnection conn,
+    QueryBatch batch,
+    std::vector<std::shared_ptr<const PreparedStatement>> statements) {
+
+    DCHECK(evb->isInEventBaseThread());
+
+    auto* pending = new AsyncBatch(evb, std::move(conn), std::move(batch), std::move(statements));
+    auto future = pending->promise_.getSemiFuture();
+
+    if (!pending->enterNonBlocking()) {
+        return future;
+    }
+
+    std::string error;
+    if (!pending->run_.send(error)) {
+        pending->onError(error);
+        return future;
+    }
+
+    // On failure the promise is already completed and the object freed
+    pending->flush();
+    return future;
+}
+
+AsyncBatch::AsyncBatch(folly::EventBase* evb,
+                       PooledConnection conn,
+                       QueryBatch batch,
+                       std::vector<std::shared_ptr<const PreparedStatement>> statements)
+    : AsyncOperation(evb, std::move(conn)),
+      batch_(std::move(batch)),
+      run_(conn_.connection(), batch_, std::move(statements)) {}
+
+bool AsyncBatch::onResult(ResultPtr result) {
+    bool synced = run_.consume(std::move(result));
+
+    if (run_.broken()) {
+        onError("Unexpected result sequence from pipelined batch");
+        return false;
+    }
+    if (!synced) {
+        return true;
+    }
+
+    auto results = run_.finish();
+    releaseConnection();
+    promise_.setValue(std::move(results));
+    delete this;
+    return false;
+}
+
+void AsyncBatch::onError(const std::string& message) {
+    LOG(ERROR) << message;
+
+    releaseConnection();
+    promise_.setException(DatabaseError(message));
+    delete this;
+}
+
+} // namespace db
+} // namespace securapp
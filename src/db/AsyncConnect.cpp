@@ -0,0 +1,119 @@
+#include "db/AsyncConnect.h"
+#include "db/PgResult.h"
+#include <glog/logging.h>
+#include <folly/net/NetworkSocket.h>
+
+namespace securapp {
+namespace db {
+
+folly::SemiFuture<std::unique_ptr<PgConnection>> AsyncConnect::open(
+    folly::EventBase* evb,
+    const std::string& connStr,
+    std::chrono::milliseconds timeout) {
+
+    DCHECK(evb->isInEventBaseThread());
+
+    PGconn* raw = PQconnectStart(connStr.c_str());
+    if (!raw) {
+        return folly::makeSemiFuture<std::unique_ptr<PgConnection>>(
+            DatabaseError("Connection to database failed: out of memory"));
+    }
+
+    auto conn = std::make_unique<PgConnection>(raw);
+    if (PQstatus(raw) == CONNECTION_BAD) {
+        return folly::makeSemiFuture<std::unique_ptr<PgConnection>>(
+            DatabaseError(std::string("Connection to database failed: ") + PQerrorMessage(raw)));
+    }
+
+    auto* pending = new AsyncConnect(evb, std::move(conn), false, timeout);
+    auto future = pending->promise_.getSemiFuture();
+
+    // A fresh connection starts by waiting for the socket to connect
+    pending->advance(PGRES_POLLING_WRITING);
+    return future;
+}
+
+folly::SemiFuture<std::unique_ptr<PgConnection>> AsyncConnect::reset(
+    folly::EventBase* evb,
+    std::unique_ptr<PgConnection> conn,
+    std::chrono::milliseconds timeout) {
+
+    DCHECK(evb->isInEventBaseThread());
+
+    conn->prepared_.clear();
+    if (!PQresetStart(conn->get())) {
+        return folly::makeSemiFuture<std::unique_ptr<PgConnection>>(
+            DatabaseError(std::string("Reconnect to database failed: ") +
+                          PQerrorMessage(conn->get())));
+    }
+
+    auto* pending = new AsyncConnect(evb, std::move(conn), true, timeout);
+    auto future = pending->promise_.getSemiFuture();
+    pending->advance(PGRES_POLLING_WRITING);
+    return future;
+}
+
+AsyncConnect::AsyncConnect(folly::EventBase* evb,
+                           std::unique_ptr<PgConnection> conn,
+                           bool resetting,
+                           std::chrono::milliseconds timeout)
+    : folly::EventHandler(evb),
+      conn_(std::move(conn)),
+      resetting_(resetting) {
+
+    // libpq enforces connect_timeout only in blocking mode
+    timeout_ = folly::AsyncTimeout::make(*evb, [this]() noexcept {
+        fail("Timed out connecting to the database");
+    });
+    timeout_->scheduleTimeout(timeout);
+}
+
+void AsyncConnect::handlerReady(uint16_t /* events */) noexcept {
+    advance(resetting_ ? PQresetPoll(conn_->get()) : PQconnectPoll(conn_->get()));
+}
+
+void AsyncConnect::advance(PostgresPollingStatusType status) {
+    if (status == PGRES_POLLING_OK) {
+        succeed();
+        return;
+    }
+    if (status == PGRES_POLLING_FAILED) {
+        fail(std::string(resetting_ ? "Reconnect to database failed: "
+                                    : "Connection to database failed: ") +
+             PQerrorMessage(conn_->get()));
+        return;
+    }
+
+    int socket = PQsocket(conn_->get());
+    if (socket < 0) {
+        fail("Connection to database failed: no socket");
+        return;
+    }
+    if (socket != socket_) {
+        unregisterHandler();
+        changeHandlerFD(folly::NetworkSocket::fromFd(socket));
+        socket_ = socket;
+    }
+
+    uint16_t events = status == PGRES_POLLING_READING ? EventHandler::READ : EventHandler::WRITE;
+    if (!registerHandler(events)) {
+        fail("Failed to register database socket with the event loop");
+    }
+}
+
+void AsyncConnect::succeed() {
+    unregisterHandler();
+    timeout_->cancelTimeout();
+    promise_.setValue(std::move(conn_));
+    delete this;
+}
+
+void AsyncConnect::fail(const std::string& message) {
+    unregisterHandler();
+    timeout_->cancelTimeout();
+    promise_.setException(DatabaseError(message));
+    delete this;
+}
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,103 @@
+#include "db/AsyncOperation.h"
+#include <glog/logging.h>
+#include <folly/net/NetworkSocket.h>
+
+namespace securapp {
+namespace db {
+
+AsyncOperation::AsyncOperation(folly::EventBase* evb, PooledConnection conn)
+    : folly::EventHandler(evb, folly::NetworkSocket::fromFd(PQsocket(conn.get()))),
+      conn_(std::move(conn)) {}
+
+bool AsyncOperation::enterNonBlocking() {
+    if (PQsetnonblocking(conn_.get(), 1) != 0) {
+        onError(std::string("Cannot switch connection to non-blocking mode: ") +
+                PQerrorMessage(conn_.get()));
+        return false;
+    }
+    return true;
+}
+
+bool AsyncOperation::flush() {
+    int pending = PQflush(conn_.get());
+    if (pending < 0) {
+        onError(std::string("Failed to flush query: ") + PQerrorMessage(conn_.get()));
+        return false;
+    }
+
+    // Only wait for writability while libpq still has unsent data
+    bool wantWrite = pending == 1;
+    if (paused_) {
+        wantWrite_ = wantWrite;
+        return true;
+    }
+    if (!isHandlerRegistered() || wantWrite != wantWrite_) {
+        wantWrite_ = wantWrite;
+        return arm();
+    }
+    return true;
+}
+
+bool AsyncOperation::arm() {
+    uint16_t events = EventHandler::READ | EventHandler::PERSIST;
+    if (wantWrite_) {
+        events |= EventHandler::WRITE;
+    }
+
+    if (!registerHandler(events)) {
+        onError("Failed to register database socket with the event loop");
+        return false;
+    }
+    return true;
+}
+
+void AsyncOperation::releaseConnection() {
+    unregisterHandler();
+    conn_.release();
+}
+
+void AsyncOperation::pauseReading() {
+    if (paused_) {
+        return;
+    }
+    paused_ = true;
+    unregisterHandler();
+}
+
+void AsyncOperation::resumeReading() {
+    if (!paused_) {
+        return;
+    }
+    paused_ = false;
+    if (!arm()) {
+        return;
+    }
+
+    // No socket event announces results libpq read before we paused
+    drainResults();
+}
+
+void AsyncOperation::handlerReady(uint16_t events) noexcept {
+    if ((events & EventHandler::WRITE) && !flush()) {
+        return;
+    }
+
+    if (events & EventHandler::READ) {
+        if (!PQconsumeInput(conn_.get())) {
+            onError(std::string("Failed to read query result: ") + PQerrorMessage(conn_.get()));
+            return;
+        }
+        drainResults();
+    }
+}
+
+void AsyncOperation::drainResults() {
+    while (!paused_ && !PQisBusy(conn_.get())) {
+        if (!onResult(ResultPtr(PQgetResult(conn_.get())))) {
+            return;
+        }
+    }
+}
+
+} // namespace db
+} // namespace securapp
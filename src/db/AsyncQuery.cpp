@@ -0,0 +1,194 @@
+#include "db/AsyncQuery.h"
+#include <glog/logging.h>
+
+namespace securapp {
+namespace db {
+
+folly::SemiFuture<ResultPtr> AsyncQuery::start(
+    folly::EventBase* evb,
+    PooledConnection conn,
+    const std::string& query,
+    std::vector<std::string> params,
+    bool expectTuples) {
+
+    DCHECK(evb->isInEventBaseThread());
+
+    auto* pending = new AsyncQuery(evb, std::move(conn), std::move(params), expectTuples);
+    auto future = pending->promise_.getSemiFuture();
+
+    // On failure the promise is already completed and the object freed
+    pending->sendQuery(query);
+    return future;
+}
+
+folly::SemiFuture<ResultPtr> AsyncQuery::start(
+    folly::EventBase* evb,
+    PooledConnection conn,
+    std::shared_ptr<const PreparedStatement> statement,
+    std::vector<std::string> params,
+    bool expectTuples) {
+
+    DCHECK(evb->isInEventBaseThread());
+
+    auto* pending = new AsyncQuery(evb, std::move(conn), std::move(params), expectTuples);
+    auto future = pending->promise_.getSemiFuture();
+    pending->statement_ = std::move(statement);
+
+    if (pending->conn_.connection()->isPrepared(pending->statement_->name)) {
+        pending->sendExecute();
+    } else {
+        pending->sendPrepare();
+    }
+    return future;
+}
+
+AsyncQuery::AsyncQuery(folly::EventBase* evb,
+                       PooledConnection conn,
+                       std::vector<std::string> params,
+                       bool expectTuples)
+    : AsyncOperation(evb, std::move(conn)),
+      params_(std::move(params)),
+      expectTuples_(expectTuples) {
+
+    // Convert string parameters to char* array once, reused on retries
+    paramValues_.reserve(params_.size());
+    for (const auto& param : params_) {
+        paramValues_.push_back(param.c_str());
+    }
+}
+
+bool AsyncQuery::sendQuery(const std::string& query) {
+    PGconn* pg = conn_.get();
+    if (!enterNonBlocking()) {
+        return false;
+    }
+
+    int sent = PQsendQueryParams(
+        pg,
+        query.c_str(),
+        static_cast<int>(paramValues_.size()),
+        nullptr,  // param types
+        paramValues_.data(),
+        nullptr,  // param lengths
+        nullptr,  // param formats
+        0  // result format (0 = text)
+    );
+
+    if (!sent) {
+        onError(std::string("Failed to send query: ") + PQerrorMessage(pg));
+        return false;
+    }
+
+    phase_ = Phase::Executing;
+    return flush();
+}
+
+bool AsyncQuery::sendPrepare() {
+    PGconn* pg = conn_.get();
+    if (!enterNonBlocking()) {
+        return false;
+    }
+
+    int sent = PQsendPrepare(
+        pg,
+        statement_->name.c_str(),
+        statement_->sql.c_str(),
+        static_cast<int>(statement_->paramTypes.size()),
+        statement_->paramTypes.empty() ? nullptr : statement_->paramTypes.data());
+
+    if (!sent) {
+        onError("Failed to prepare statement " + statement_->name + ": " + PQerrorMessage(pg));
+        return false;
+    }
+
+    phase_ = Phase::Preparing;
+    return flush();
+}
+
+bool AsyncQuery::sendExecute() {
+    PGconn* pg = conn_.get();
+    if (!enterNonBlocking()) {
+        return false;
+    }
+
+    int sent = PQsendQueryPrepared(
+        pg,
+        statement_->name.c_str(),
+        static_cast<int>(paramValues_.size()),
+        paramValues_.data(),
+        nullptr,  // param lengths
+        nullptr,  // param formats
+        statement_->resultFormat()
+    );
+
+    if (!sent) {
+        onError("Failed to execute statement " + statement_->name + ": " + PQerrorMessage(pg));
+        return false;
+    }
+
+    phase_ = Phase::Executing;
+    return flush();
+}
+
+bool AsyncQuery::onResult(ResultPtr result) {
+    if (!result) {
+        // All results for the command have arrived
+        return onCommandDone();
+    }
+
+    // Keep the first error, otherwise the last result
+    if (!result_ || resultSucceeded(result_.get(), false)) {
+        result_ = std::move(result);
+    }
+    return true;
+}
+
+bool AsyncQuery::onCommandDone() {
+    if (phase_ == Phase::Preparing) {
+        if (!resultSucceeded(result_.get(), false)) {
+            onError("Failed to prepare statement " + statement_->name + ": " +
+                    (result_ ? PQresultErrorMessage(result_.get()) : PQerrorMessage(conn_.get())));
+            return false;
+        }
+        conn_.connection()->markPrepared(statement_->name);
+        result_.reset();
+        return sendExecute();
+    }
+
+    // The session lost the statement behind our back (e.g. DISCARD ALL):
+    // prepare it again once and retry
+    if (statement_ && !retried_ && hasSqlState(result_.get(), kSqlStateUndefinedStatement)) {
+        retried_ = true;
+        conn_.connection()->forgetPrepared(statement_->name);
+        result_.reset();
+        return sendPrepare();
+    }
+
+    finish();
+    return false;
+}
+
+void AsyncQuery::finish() {
+    if (!resultSucceeded(result_.get(), expectTuples_)) {
+        const char* sqlState = result_ ? PQresultErrorField(result_.get(), PG_DIAG_SQLSTATE) : nullptr;
+        sqlState_ = sqlState ? sqlState : "";
+        onError(std::string("Query execution failed: ") +
+                (result_ ? PQresultErrorMessage(result_.get()) : PQerrorMessage(conn_.get())));
+        return;
+    }
+
+    releaseConnection();
+    promise_.setValue(std::move(result_));
+    delete this;
+}
+
+void AsyncQuery::onError(const std::string& message) {
+    LOG(ERROR) << message;
+
+    releaseConnection();
+    promise_.setException(DatabaseError(message, sqlState_));
+    delete this;
+}
+
+} // namespace db
+} // namespace securapp
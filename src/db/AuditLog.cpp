@@ -0,0 +1,263 @@
+#include "db/AuditLog.h"
+#include "db/DatabaseManager.h"
+#include "util/Metrics.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <string_view>
+
+namespace securapp {
+namespace db {
+
+namespace {
+
+constexpr const char* kCopySql =
+    "COPY audit_log (user_id, action, resource_type, resource_id, details, "
+    "ip_address, user_agent, timestamp) FROM STDIN";
+
+// A batch the database keeps refusing is given up after this many tries
+constexpr int kMaxAttempts = 3;
+
+uint64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Append a COPY text field: at most 'limit' bytes (the column width),
+// printable ASCII only so no row can fail on encoding, with the COPY
+// delimiter and escape characters escaped. Empty values are NULL.
+void appendField(std::string& out, std::string_view value, size_t limit) {
+    if (value.empty()) {
+        out += "\\N";
+        return;
+    }
+    for (char c : value.substr(0, limit)) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            default:
+                out += (c >= 0x20 && c < 0x7f) ? c : '?';
+                break;
+        }
+    }
+}
+
+// One line of COPY text format for 'event'
+void appendRow(std::string& out, const AuditEvent& event) {
+    if (event.userId > 0) {
+        out += std::to_string(event.userId);
+    } else {
+        out += "\\N";
+    }
+    out += '\t';
+    appendField(out, event.action, 50);
+    out += '\t';
+    appendField(out, event.resourceType, 50);
+    out += '\t';
+    appendField(out, event.resourceId, 50);
+    out += '\t';
+    // Never truncated: a cut JSON document would fail the whole batch
+    appendField(out, event.details, std::string_view::npos);
+    out += '\t';
+    appendField(out, event.ipAddress, 45);
+    out += '\t';
+    appendField(out, event.userAgent, 255);
+    out += '\t';
+
+    // The column has no time zone; audit times are UTC
+    time_t seconds = static_cast<time_t>(event.timestampUs / 1000000);
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+    char timestamp[32];
+    int length = std::snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02d %02d:%02d:%02d.%06u",
+        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+        static_cast<unsigned>(event.timestampUs % 1000000));
+    out.append(timestamp, std::min<size_t>(length, sizeof(timestamp) - 1));
+    out += '\n';
+}
+
+} // namespace
+
+AuditLogOptions AuditLogOptions::fromConfig(const json& auditConfig) {
+    AuditLogOptions options;
+    options.enabled = auditConfig.value("enabled", options.enabled);
+    options.queueSize = std::max<size_t>(auditConfig.value("queue_size", options.queueSize), 1);
+    options.batchSize = std::max<size_t>(auditConfig.value("batch_size", options.batchSize), 1);
+    options.flushInterval = std::chrono::milliseconds(
+        auditConfig.value("flush_ms", options.flushInterval.count()));
+    options.blockWhenFull = auditConfig.value("overflow", std::string("drop")) == "block";
+    options.blockTimeout = std::chrono::milliseconds(
+        auditConfig.value("block_ms", options.blockTimeout.count()));
+    return options;
+}
+
+AuditLog& AuditLog::getInstance() {
+    static AuditLog instance;
+    return instance;
+}
+
+AuditLog::~AuditLog() {
+    stop();
+}
+
+void AuditLog::start(const AuditLogOptions& options) {
+    if (running_.load() || !options.enabled) {
+        return;
+    }
+
+    auto& metrics = util::Metrics::getInstance();
+    writtenCounter_ = metrics.counter("audit_events_written_total", "",
+        "Audit events written to audit_log");
+    droppedCounter_ = metrics.counter("audit_events_dropped_total", "",
+        "Audit events lost to a full queue or a failing database");
+
+    options_ = options;
+    if (!queue_) {
+        queue_ = std::make_unique<folly::MPMCQueue<AuditEvent>>(options_.queueSize);
+    }
+    stopping_.store(false);
+    writer_ = std::thread([this] { writeLoop(); });
+    running_.store(true, std::memory_order_release);
+}
+
+void AuditLog::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    // The wake-up event ends the writer's wait at once
+    stopping_.store(true, std::memory_order_release);
+    queue_->blockingWrite(AuditEvent());
+    writer_.join();
+
+    LOG(INFO) << "Audit log stopped: " << written() << " events written, "
+              << dropped() << " dropped";
+}
+
+bool AuditLog::record(AuditEvent event) {
+    if (!running_.load(std::memory_order_acquire) || event.action.empty()) {
+        return false;
+    }
+    if (event.timestampUs == 0) {
+        event.timestampUs = nowMicros();
+    }
+
+    bool queued = options_.blockWhenFull
+        ? queue_->tryWriteUntil(std::chrono::steady_clock::now() + options_.blockTimeout,
+                                std::move(event))
+        : queue_->write(std::move(event));
+    if (!queued) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        util::Metrics::getInstance().add(droppedCounter_);
+    }
+    return queued;
+}
+
+void AuditLog::writeLoop() {
+    std::vector<AuditEvent> batch;
+    batch.reserve(options_.batchSize);
+    std::string buffer;
+    int attempts = 0;
+    uint64_t reportedDrops = 0;
+
+    while (true) {
+        // Collect until the batch is full or the oldest event has waited
+        // the flush interval
+        auto deadline = std::chrono::steady_clock::now() + options_.flushInterval;
+        AuditEvent event;
+        while (batch.size() < options_.batchSize && queue_->tryReadUntil(deadline, event)) {
+            if (!event.action.empty()) {
+                batch.push_back(std::move(event));
+            } else if (stopping_.load(std::memory_order_acquire)) {
+                break;
+            }
+        }
+        bool stopping = stopping_.load(std::memory_order_acquire);
+
+        // On the way out, write everything still queued
+        while (stopping && queue_->read(event)) {
+            if (!event.action.empty()) {
+                batch.push_back(std::move(event));
+            }
+        }
+
+        if (!batch.empty()) {
+            size_t stored = 0;
+            bool flushed = write(batch, 0, batch.size(), buffer, stored);
+            if (stored > 0) {
+                written_.fetch_add(stored, std::memory_order_relaxed);
+                util::Metrics::getInstance().add(writtenCounter_, stored);
+            }
+
+            // Only what was not stored is retried
+            batch.erase(batch.begin(), batch.begin() + stored);
+            if (flushed) {
+                attempts = 0;
+            } else if (++attempts >= kMaxAttempts || stopping) {
+                LOG(ERROR) << "Giving up on " << batch.size() << " audit events";
+                dropped_.fetch_add(batch.size(), std::memory_order_relaxed);
+                util::Metrics::getInstance().add(droppedCounter_, batch.size());
+                batch.clear();
+                attempts = 0;
+            } else {
+                // Retried after a pause; the queue absorbs new events meanwhile
+                std::this_thread::sleep_for(options_.flushInterval);
+            }
+        }
+
+        uint64_t drops = dropped();
+        if (drops != reportedDrops) {
+            LOG(WARNING) << "Audit log dropped " << (drops - reportedDrops) << " events";
+            reportedDrops = drops;
+        }
+
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+bool AuditLog::write(std::vector<AuditEvent>& batch, size_t begin, size_t end,
+                     std::string& buffer, size_t& written) {
+    std::string sqlState;
+    if (flush(batch, begin, end, buffer, sqlState)) {
+        written += end - begin;
+        return true;
+    }
+    if (sqlState != kSqlStateForeignKeyViolation) {
+        return false;
+    }
+
+    if (end - begin == 1) {
+        AuditEvent& event = batch[begin];
+        if (event.userId <= 0) {
+            return false;
+        }
+        // The user was deleted since; keep the event without them, as
+        // ON DELETE SET NULL does for events written earlier
+        LOG(WARNING) << "Audit event " << event.action << " refers to deleted user "
+                     << event.userId << ", writing it without a user";
+        event.userId = 0;
+        return write(batch, begin, end, buffer, written);
+    }
+
+    size_t middle = begin + (end - begin) / 2;
+    return write(batch, begin, middle, buffer, written) &&
+           write(batch, middle, end, buffer, written);
+}
+
+bool AuditLog::flush(const std::vector<AuditEvent>& batch, size_t begin, size_t end,
+                     std::string& buffer, std::string& sqlState) {
+    buffer.clear();
+    for (size_t i = begin; i < end; i++) {
+        appendRow(buffer, batch[i]);
+    }
+    return DatabaseManager::getInstance().copyIn(kCopySql, buffer, &sqlState);
+}
+
+} // namespace db
+} // namespace securapp
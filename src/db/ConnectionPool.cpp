@@ -0,0 +1,535 @@
+#include "db/ConnectionPool.h"
+#include "db/AsyncConnect.h"
+#include "db/PgResult.h"
+#include "util/Metrics.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <optional>
+
+namespace securapp {
+namespace db {
+
+PoolOptions PoolOptions::fromConfig(const json& poolConfig) {
+    PoolOptions options;
+    if (!poolConfig.is_object()) {
+        return options;
+    }
+
+    options.minConnections = poolConfig.value("min_connections", options.minConnections);
+    options.maxConnections = poolConfig.value("max_connections", options.maxConnections);
+    options.idleTimeout = std::chrono::milliseconds(
+        poolConfig.value("idle_timeout_ms", static_cast<int64_t>(options.idleTimeout.count())));
+    options.checkoutTimeout = std::chrono::milliseconds(
+        poolConfig.value("checkout_timeout_ms", static_cast<int64_t>(options.checkoutTimeout.count())));
+
+    // Keep the bounds consistent
+    options.maxConnections = std::max<size_t>(options.maxConnections, 1);
+    options.minConnections = std::min(options.minConnections, options.maxConnections);
+    return options;
+}
+
+PgConnection::PgConnection(PGconn* conn)
+    : conn_(conn), lastUsed_(std::chrono::steady_clock::now()) {}
+
+PgConnection::~PgConnection() {
+    if (conn_) {
+        PQfinish(conn_);
+    }
+}
+
+bool PgConnection::isHealthy() const {
+    return conn_ && PQstatus(conn_) == CONNECTION_OK;
+}
+
+bool PgConnection::reset() {
+    if (!conn_) {
+        return false;
+    }
+    PQreset(conn_);
+    prepared_.clear();
+    return PQstatus(conn_) == CONNECTION_OK;
+}
+
+bool PgConnection::prepare(const PreparedStatement& statement) {
+    ResultPtr result(PQprepare(
+        conn_,
+        statement.name.c_str(),
+        statement.sql.c_str(),
+        static_cast<int>(statement.paramTypes.size()),
+        statement.paramTypes.empty() ? nullptr : statement.paramTypes.data()));
+
+    if (PQresultStatus(result.get()) != PGRES_COMMAND_OK) {
+        LOG(ERROR) << "Failed to prepare statement " << statement.name << ": "
+                   << PQerrorMessage(conn_);
+        return false;
+    }
+
+    markPrepared(statement.name);
+    return true;
+}
+
+PooledConnection::PooledConnection(ConnectionPool* pool, std::unique_ptr<PgConnection> conn)
+    : pool_(pool), conn_(std::move(conn)) {}
+
+PooledConnection::~PooledConnection() {
+    release();
+}
+
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept
+    : pool_(other.pool_), conn_(std::move(other.conn_)) {
+    other.pool_ = nullptr;
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        conn_ = std::move(other.conn_);
+        other.pool_ = nullptr;
+    }
+    return *this;
+}
+
+void PooledConnection::release() {
+    if (pool_ && conn_) {
+        pool_->release(std::move(conn_));
+    }
+    pool_ = nullptr;
+    conn_.reset();
+}
+
+ConnectionPool::ConnectionPool(std::string connStr, PoolOptions options)
+    : connStr_(std::move(connStr)), options_(options) {
+    waitHistogram_ = util::Metrics::getInstance().histogram("db_pool_checkout_wait_seconds", "",
+        "Time spent waiting for a pooled database connection");
+}
+
+ConnectionPool::~ConnectionPool() {
+    shutdown();
+}
+
+bool ConnectionPool::start() {
+    // Always open at least one connection so a bad config fails fast
+    size_t initial = std::max<size_t>(options_.minConnections, 1);
+
+    for (size_t i = 0; i < initial; i++) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++total_;
+        }
+
+        auto conn = connect();
+        if (!conn) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --total_;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(std::move(conn));
+    }
+
+    reaper_ = std::thread([this] { reapLoop(); });
+
+    LOG(INFO) << "Connection pool started with " << initial << " connections (max "
+              << options_.maxConnections << ")";
+    return true;
+}
+
+void ConnectionPool::shutdown() {
+    std::vector<std::unique_ptr<PgConnection>> closing;
+    std::deque<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shutdown_) {
+            return;
+        }
+        shutdown_ = true;
+        closing.swap(idle_);
+        waiters.swap(waiters_);
+        total_ -= closing.size();
+    }
+    available_.notify_all();
+    reaperWake_.notify_all();
+    if (reaper_.joinable()) {
+        reaper_.join();
+    }
+
+    for (auto& waiter : waiters) {
+        waiter.promise.setException(DatabaseError("Connection pool is shut down"));
+    }
+
+    if (!closing.empty()) {
+        LOG(INFO) << "Connection pool closed " << closing.size() << " idle connections";
+    }
+}
+
+PooledConnection ConnectionPool::acquire() {
+    return acquire(options_.checkoutTimeout);
+}
+
+PooledConnection ConnectionPool::acquire(std::chrono::milliseconds timeout) {
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + timeout;
+
+    std::unique_ptr<PgConnection> conn;
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!conn) {
+        if (shutdown_) {
+            return PooledConnection();
+        }
+
+        if (!idle_.empty()) {
+            conn = takeIdleLocked();
+            break;
+        }
+
+        if (total_ < options_.maxConnections) {
+            // Reserve the slot, then connect without holding the lock
+            ++total_;
+            lock.unlock();
+            conn = connect();
+            if (!conn) {
+                freeSlot();
+                return PooledConnection();
+            }
+            break;
+        }
+
+        if (available_.wait_until(lock, deadline) == std::cv_status::timeout &&
+            idle_.empty() && total_ >= options_.maxConnections) {
+            checkoutTimeouts_.fetch_add(1, std::memory_order_relaxed);
+            LOG(WARNING) << "Timed out waiting for a database connection after "
+                         << timeout.count() << "ms";
+            return PooledConnection();
+        }
+    }
+
+    if (lock.owns_lock()) {
+        lock.unlock();
+    }
+
+    // Transparently reconnect connections that broke while idle
+    if (!conn->isHealthy()) {
+        LOG(WARNING) << "Database connection is broken, reconnecting";
+        if (!conn->reset()) {
+            LOG(ERROR) << "Reconnect failed: " << PQerrorMessage(conn->get());
+            conn.reset();
+            freeSlot();
+            return PooledConnection();
+        }
+        reconnects_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    recordWait(std::chrono::steady_clock::now() - start);
+    return PooledConnection(this, std::move(conn));
+}
+
+folly::SemiFuture<PooledConnection> ConnectionPool::acquireAsync(folly::EventBase* evb) {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<PgConnection> conn;
+    folly::SemiFuture<PooledConnection> pending = folly::SemiFuture<PooledConnection>::makeEmpty();
+    std::shared_ptr<std::atomic<bool>> abandoned;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shutdown_) {
+            return folly::makeSemiFuture<PooledConnection>(
+                DatabaseError("Connection pool is shut down"));
+        }
+
+        if (!idle_.empty()) {
+            conn = takeIdleLocked();
+        } else if (total_ < options_.maxConnections) {
+            ++total_;
+        } else {
+            // Park until release() hands a connection over
+            abandoned = std::make_shared<std::atomic<bool>>(false);
+            waiters_.push_back(Waiter{folly::Promise<PooledConnection>(), start, evb, abandoned});
+            pending = waiters_.back().promise.getSemiFuture();
+        }
+    }
+
+    if (pending.valid()) {
+        return std::move(pending)
+            .within(options_.checkoutTimeout)
+            .deferError(folly::tag_t<folly::FutureTimeout>{},
+                [this, abandoned](const folly::FutureTimeout&) -> PooledConnection {
+                    abandoned->store(true, std::memory_order_release);
+                    checkoutTimeouts_.fetch_add(1, std::memory_order_relaxed);
+                    throw DatabaseError("Timed out waiting for a database connection");
+                });
+    }
+
+    if (conn && conn->isHealthy()) {
+        recordWait(std::chrono::steady_clock::now() - start);
+        return folly::makeSemiFuture(PooledConnection(this, std::move(conn)));
+    }
+
+    // Connecting takes whole round trips; poll the handshake on the loop
+    bool reconnect = conn != nullptr;
+    if (reconnect) {
+        LOG(WARNING) << "Database connection is broken, reconnecting";
+    }
+    auto connecting = folly::makeSemiFuture()
+        .via(evb)
+        .thenValue([this, evb, conn = std::move(conn)](folly::Unit) mutable {
+            return conn ? AsyncConnect::reset(evb, std::move(conn), options_.checkoutTimeout)
+                        : AsyncConnect::open(evb, connStr_, options_.checkoutTimeout);
+        });
+    return std::move(connecting)
+        .thenTry([this, reconnect, start](folly::Try<std::unique_ptr<PgConnection>>&& result) {
+            return connected(std::move(result), reconnect, start);
+        })
+        .semi();
+}
+
+PooledConnection ConnectionPool::connected(folly::Try<std::unique_ptr<PgConnection>>&& conn,
+                                           bool reconnected,
+                                           std::chrono::steady_clock::time_point start) {
+    if (conn.hasException()) {
+        LOG(ERROR) << conn.exception().what();
+        freeSlot();
+        conn.exception().throw_exception();
+    }
+
+    if (reconnected) {
+        reconnects_.fetch_add(1, std::memory_order_relaxed);
+    }
+    recordWait(std::chrono::steady_clock::now() - start);
+    return PooledConnection(this, std::move(conn).value());
+}
+
+bool ConnectionPool::isHealthy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutdown_ || total_ == 0) {
+        return false;
+    }
+    // Connections that are checked out are in use and assumed to be fine
+    return idle_.empty() || idle_.back()->isHealthy();
+}
+
+PoolStats ConnectionPool::getStats() const {
+    PoolStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.total = total_;
+        stats.idle = idle_.size();
+    }
+    stats.checkouts = checkouts_.load(std::memory_order_relaxed);
+    stats.checkoutTimeouts = checkoutTimeouts_.load(std::memory_order_relaxed);
+    stats.checkoutWaitTotalUs = checkoutWaitTotalUs_.load(std::memory_order_relaxed);
+    stats.checkoutWaitMaxUs = checkoutWaitMaxUs_.load(std::memory_order_relaxed);
+    stats.reconnects = reconnects_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ConnectionPool::release(std::unique_ptr<PgConnection> conn) {
+    bool reusable = conn->isHealthy();
+
+    // Async users switch the connection to non-blocking mode
+    if (reusable && PQisnonblocking(conn->get())) {
+        PQsetnonblocking(conn->get(), 0);
+    }
+
+    // A batch that failed half way can leave the session in pipeline mode
+    if (reusable && PQpipelineStatus(conn->get()) != PQ_PIPELINE_OFF) {
+        reusable = false;
+    }
+
+    if (reusable) {
+        PGTransactionStatusType txStatus = PQtransactionStatus(conn->get());
+        if (txStatus == PQTRANS_INTRANS || txStatus == PQTRANS_INERROR) {
+            // Never hand out a connection with an open transaction
+            LOG(WARNING) << "Connection returned to pool inside a transaction, rolling back";
+            PQclear(PQexec(conn->get(), "ROLLBACK"));
+        } else if (txStatus != PQTRANS_IDLE) {
+            reusable = false;
+        }
+    }
+
+    conn->lastUsed_ = std::chrono::steady_clock::now();
+    conn->lastThread_ = std::this_thread::get_id();
+
+    std::vector<std::unique_ptr<PgConnection>> expired;
+    std::vector<Waiter> abandoned;
+    std::optional<Waiter> waiter;
+    bool dropped = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shutdown_) {
+            --total_;
+            expired.push_back(std::move(conn));
+        } else if (!reusable) {
+            // The slot stays reserved until freeSlot() passes it on
+            dropped = true;
+            expired.push_back(std::move(conn));
+        } else {
+            // Hand the connection straight to the oldest async waiter
+            waiter = takeWaiterLocked(abandoned);
+            if (!waiter) {
+                idle_.push_back(std::move(conn));
+                reapIdleLocked(expired);
+            }
+        }
+    }
+
+    if (dropped) {
+        // Close it first, then let a waiting checkout have the slot
+        expired.clear();
+        freeSlot();
+        return;
+    }
+
+    if (waiter) {
+        recordWait(std::chrono::steady_clock::now() - waiter->since);
+        // A waiter timing out just now sends the connection straight back
+        waiter->promise.setValue(PooledConnection(this, std::move(conn)));
+        return;
+    }
+    available_.notify_one();
+
+    // Expired connections are closed here, outside the lock
+}
+
+std::unique_ptr<PgConnection> ConnectionPool::connect() {
+    PGconn* raw = PQconnectdb(connStr_.c_str());
+
+    if (PQstatus(raw) != CONNECTION_OK) {
+        LOG(ERROR) << "Connection to database failed: " << PQerrorMessage(raw);
+        PQfinish(raw);
+        return nullptr;
+    }
+
+    return std::make_unique<PgConnection>(raw);
+}
+
+void ConnectionPool::freeSlot() {
+    std::vector<Waiter> abandoned;
+    std::optional<Waiter> waiter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!shutdown_) {
+            waiter = takeWaiterLocked(abandoned);
+        }
+        if (!waiter) {
+            --total_;
+        }
+    }
+
+    if (waiter) {
+        connectFor(std::move(*waiter));
+        return;
+    }
+    available_.notify_one();
+}
+
+void ConnectionPool::connectFor(Waiter waiter) {
+    folly::EventBase* evb = waiter.evb;
+    folly::makeSemiFuture()
+        .via(evb)
+        .thenValue([this, evb](folly::Unit) {
+            return AsyncConnect::open(evb, connStr_, options_.checkoutTimeout);
+        })
+        .thenTry([this, waiter = std::move(waiter)](
+                     folly::Try<std::unique_ptr<PgConnection>>&& conn) mutable {
+            if (conn.hasException()) {
+                LOG(ERROR) << conn.exception().what();
+                waiter.promise.setException(conn.exception());
+                freeSlot();
+                return;
+            }
+            if (waiter.abandoned->load(std::memory_order_acquire)) {
+                // Timed out meanwhile; the connection serves the next caller
+                release(std::move(conn).value());
+                return;
+            }
+            recordWait(std::chrono::steady_clock::now() - waiter.since);
+            waiter.promise.setValue(PooledConnection(this, std::move(conn).value()));
+        });
+}
+
+std::optional<ConnectionPool::Waiter> ConnectionPool::takeWaiterLocked(std::vector<Waiter>& abandoned) {
+    while (!waiters_.empty()) {
+        Waiter waiter = std::move(waiters_.front());
+        waiters_.pop_front();
+        if (!waiter.abandoned->load(std::memory_order_acquire)) {
+            return waiter;
+        }
+        abandoned.push_back(std::move(waiter));
+    }
+    return std::nullopt;
+}
+
+std::unique_ptr<PgConnection> ConnectionPool::takeIdleLocked() {
+    auto self = std::this_thread::get_id();
+
+    // Most recently released connections are at the back
+    auto it = std::find_if(idle_.rbegin(), idle_.rend(),
+        [&](const std::unique_ptr<PgConnection>& c) { return c->lastThread_ == self; });
+    auto pos = (it != idle_.rend()) ? std::prev(it.base()) : std::prev(idle_.end());
+
+    std::unique_ptr<PgConnection> conn = std::move(*pos);
+    idle_.erase(pos);
+    return conn;
+}
+
+void ConnectionPool::reapIdleLocked(std::vector<std::unique_ptr<PgConnection>>& expired) {
+    auto cutoff = std::chrono::steady_clock::now() - options_.idleTimeout;
+
+    // The front of the idle list holds the connections released longest ago
+    size_t reap = 0;
+    while (reap < idle_.size() &&
+           total_ - reap > options_.minConnections &&
+           idle_[reap]->lastUsed_ < cutoff) {
+        reap++;
+    }
+
+    if (reap == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < reap; i++) {
+        expired.push_back(std::move(idle_[i]));
+    }
+    idle_.erase(idle_.begin(), idle_.begin() + reap);
+    total_ -= reap;
+}
+
+void ConnectionPool::reapLoop() {
+    // Connections are closed at most this long after their idle timeout
+    auto interval = std::max<std::chrono::milliseconds>(
+        options_.idleTimeout / 4, std::chrono::milliseconds(1000));
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!reaperWake_.wait_for(lock, interval, [this] { return shutdown_; })) {
+        std::vector<std::unique_ptr<PgConnection>> expired;
+        reapIdleLocked(expired);
+        if (expired.empty()) {
+            continue;
+        }
+
+        // Closed outside the lock
+        lock.unlock();
+        VLOG(1) << "Connection pool closed " << expired.size() << " idle connections";
+        expired.clear();
+        lock.lock();
+    }
+}
+
+void ConnectionPool::recordWait(std::chrono::steady_clock::duration waited) {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+
+    checkouts_.fetch_add(1, std::memory_order_relaxed);
+    checkoutWaitTotalUs_.fetch_add(us, std::memory_order_relaxed);
+    util::Metrics::getInstance().observe(waitHistogram_, us);
+
+    uint64_t prevMax = checkoutWaitMaxUs_.load(std::memory_order_relaxed);
+    while (us > prevMax &&
+           !checkoutWaitMaxUs_.compare_exchange_weak(prevMax, us, std::memory_order_relaxed)) {
+    }
+}
+
+} // namespace db
+} // namespace securapp
@@ -1,10 +1,36 @@
 #include "db/DatabaseManager.h"
+#include "db/AsyncBatch.h"
+#include "db/AsyncQuery.h"
+#include "db/ResultConverter.h"
+#include "util/Metrics.h"
 #include <glog/logging.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <algorithm>
 
 namespace securapp {
 namespace db {
 
-DatabaseManager::DatabaseManager() : conn_(nullptr) {}
+namespace {
+
+// Connection pinned to the calling thread between beginTransaction() and
+// commitTransaction()/rollbackTransaction()
+thread_local PooledConnection tlsTransactionConn;
+
+// Record the execution time of a statement since 'started', and its end
+// in 'timing' if the caller asked for it
+void recordLatency(size_t histogram, std::chrono::steady_clock::time_point started,
+                   QueryTiming* timing = nullptr) {
+    auto finished = std::chrono::steady_clock::now();
+    if (timing) {
+        timing->finished = finished;
+    }
+    util::Metrics::getInstance().observe(histogram,
+        std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count());
+}
+
+} // namespace
+
+DatabaseManager::DatabaseManager() = default;
 
 DatabaseManager& DatabaseManager::getInstance() {
     static DatabaseManager instance;
@@ -30,15 +56,26 @@ bool DatabaseManager::initialize(const json& dbConfig) {
             "dbname=" + dbname_ + " " +
             "sslmode=" + sslMode_;
 
-        // Connect to the database
-        conn_ = PQconnectdb(connStr.c_str());
+        streamChunkBytes_ = dbConfig.value("stream_chunk_bytes", streamChunkBytes_);
 
-        // Check connection status
-        if (PQstatus(conn_) != CONNECTION_OK) {
-            LOG(ERROR) << "Connection to database failed: " << PQerrorMessage(conn_);
-            close();
+        PoolOptions options = PoolOptions::fromConfig(dbConfig.value("pool", json::object()));
+
+        // Open the pool; this fails if the first connection cannot be made
+        auto pool = std::make_unique<ConnectionPool>(connStr, options);
+        if (!pool->start()) {
+            LOG(ERROR) << "Failed to open connection pool for database " << dbname_;
             return false;
         }
+        pool_ = std::move(pool);
+
+        // Result caching needs a connection of its own to hear about
+        // changes; it listens once startResultCache() is called
+        ResultCacheOptions cacheOptions =
+            ResultCacheOptions::fromConfig(dbConfig.value("result_cache", json::object()));
+        if (cacheOptions.enabled) {
+            resultCache_ = std::make_shared<ResultCache>(cacheOptions);
+            connStr_ = connStr;
+        }
 
         LOG(INFO) << "Successfully connected to PostgreSQL database " << dbname_;
         return true;
@@ -49,173 +86,594 @@ bool DatabaseManager::initialize(const json& dbConfig) {
     }
 }
 
+void DatabaseManager::startResultCache() {
+    if (resultCache_) {
+        resultCache_->start(connStr_);
+    }
+}
+
 void DatabaseManager::close() {
-    if (conn_) {
-        PQfinish(conn_);
-        conn_ = nullptr;
+    if (resultCache_) {
+        resultCache_->stop();
+        resultCache_.reset();
+    }
+    if (pool_) {
+        tlsTransactionConn.release();
+        pool_->shutdown();
+        pool_.reset();
         LOG(INFO) << "Database connection closed";
     }
 }
 
 bool DatabaseManager::isConnected() const {
-    return conn_ && (PQstatus(conn_) == CONNECTION_OK);
+    return pool_ && pool_->isHealthy();
 }
 
-bool DatabaseManager::execute(const std::string& query) {
-    if (!isConnected()) {
-        LOG(ERROR) << "Cannot execute query: no connection";
-        return false;
+PoolStats DatabaseManager::getPoolStats() const {
+    return pool_ ? pool_->getStats() : PoolStats();
+}
+
+PooledConnection* DatabaseManager::checkout(PooledConnection& holder) {
+    if (tlsTransactionConn) {
+        return &tlsTransactionConn;
     }
+    if (!pool_) {
+        return nullptr;
+    }
+    holder = pool_->acquire();
+    return holder ? &holder : nullptr;
+}
 
-    PGresult* result = PQexec(conn_, query.c_str());
-    ExecStatusType status = PQresultStatus(result);
+ResultPtr DatabaseManager::run(const std::string& query, const std::vector<std::string>* params,
+                               bool expectTuples) {
+    PooledConnection holder;
+    PooledConnection* conn = checkout(holder);
+    if (!conn) {
+        LOG(ERROR) << "Cannot execute " << (params ? "parameterized " : "") << "query: no connection";
+        return nullptr;
+    }
 
-    if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
-        LOG(ERROR) << "Query execution failed: " << PQerrorMessage(conn_);
-        PQclear(result);
-        return false;
+    ResultPtr result;
+    if (params) {
+        // Convert string parameters to char* array
+        std::vector<const char*> paramValues;
+        paramValues.reserve(params->size());
+        for (const auto& param : *params) {
+            paramValues.push_back(param.c_str());
+        }
+
+        result.reset(PQexecParams(
+            conn->get(),
+            query.c_str(),
+            static_cast<int>(params->size()),
+            nullptr,  // param types
+            paramValues.data(),
+            nullptr,  // param lengths
+            nullptr,  // param formats
+            0  // result format (0 = text)
+        ));
+    } else {
+        result.reset(PQexec(conn->get(), query.c_str()));
     }
 
-    PQclear(result);
-    return true;
+    if (!resultSucceeded(result.get(), expectTuples)) {
+        LOG(ERROR) << (params ? "Parameterized query" : "Query") << " execution failed: "
+                   << PQerrorMessage(conn->get());
+        return nullptr;
+    }
+
+    return result;
 }
 
-bool DatabaseManager::executeParams(const std::string& query, const std::vector<std::string>& params) {
-    if (!isConnected()) {
-        LOG(ERROR) << "Cannot execute parameterized query: no connection";
-        return false;
+ResultPtr DatabaseManager::runPrepared(const PreparedStatement& statement,
+                                       const std::vector<std::string>& params,
+                                       bool expectTuples) {
+    PooledConnection holder;
+    PooledConnection* conn = checkout(holder);
+    if (!conn) {
+        LOG(ERROR) << "Cannot execute statement " << statement.name << ": no connection";
+        return nullptr;
     }
+    PgConnection* session = conn->connection();
+    auto started = std::chrono::steady_clock::now();
 
     // Convert string parameters to char* array
     std::vector<const char*> paramValues;
+    paramValues.reserve(params.size());
     for (const auto& param : params) {
         paramValues.push_back(param.c_str());
     }
 
-    PGresult* result = PQexecParams(
-        conn_,
-        query.c_str(),
-        static_cast<int>(params.size()),
-        nullptr,  // param types
-        paramValues.data(),
-        nullptr,  // param lengths
-        nullptr,  // param formats
-        0  // result format (0 = text)
-    );
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!session->isPrepared(statement.name) && !session->prepare(statement)) {
+            return nullptr;
+        }
 
-    ExecStatusType status = PQresultStatus(result);
+        ResultPtr result(PQexecPrepared(
+            conn->get(),
+            statement.name.c_str(),
+            static_cast<int>(params.size()),
+            paramValues.data(),
+            nullptr,  // param lengths
+            nullptr,  // param formats
+            statement.resultFormat()
+        ));
+
+        if (resultSucceeded(result.get(), expectTuples)) {
+            recordLatency(statement.latencyHistogram, started);
+            return result;
+        }
 
-    if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
-        LOG(ERROR) << "Parameterized query execution failed: " << PQerrorMessage(conn_);
-        PQclear(result);
-        return false;
+        // The session lost the statement behind our back, prepare it again
+        if (attempt == 0 && hasSqlState(result.get(), kSqlStateUndefinedStatement)) {
+            session->forgetPrepared(statement.name);
+            continue;
+        }
+
+        LOG(ERROR) << "Statement " << statement.name << " execution failed: "
+                   << PQerrorMessage(conn->get());
+        break;
+    }
+    return nullptr;
+}
+
+bool DatabaseManager::registerStatement(const std::string& name, const std::string& sql,
+                                        std::vector<Oid> paramTypes,
+                                        bool binaryResults) {
+    std::unique_lock<std::shared_mutex> lock(statementsMutex_);
+
+    auto existing = statements_.find(name);
+    if (existing != statements_.end()) {
+        if (existing->second->sql != sql) {
+            LOG(ERROR) << "Statement " << name << " is already registered with different SQL";
+            return false;
+        }
+        return true;
     }
 
-    PQclear(result);
+    auto statement = std::make_shared<PreparedStatement>();
+    statement->id = statements_.size();
+    statement->name = name;
+    statement->sql = sql;
+    statement->paramTypes = std::move(paramTypes);
+    statement->binaryResults = binaryResults;
+    statement->latencyHistogram = util::Metrics::getInstance().histogram(
+        "db_statement_duration_seconds", "statement=\"" + name + "\"",
+        "Execution time of prepared statements, from checkout to the last row");
+    statements_.emplace(name, std::move(statement));
     return true;
 }
 
+std::shared_ptr<const PreparedStatement> DatabaseManager::findStatement(const std::string& name) const {
+    std::shared_lock<std::shared_mutex> lock(statementsMutex_);
+    auto it = statements_.find(name);
+    return it != statements_.end() ? it->second : nullptr;
+}
+
+bool DatabaseManager::execute(const std::string& query) {
+    return run(query, nullptr, false) != nullptr;
+}
+
+bool DatabaseManager::executeParams(const std::string& query, const std::vector<std::string>& params) {
+    return run(query, &params, false) != nullptr;
+}
+
 json DatabaseManager::executeQuery(const std::string& query) {
-    if (!isConnected()) {
-        LOG(ERROR) << "Cannot execute query: no connection";
+    ResultPtr result = run(query, nullptr, true);
+    if (!result) {
         return json::array();
     }
+    return resultToJson(result.get());
+}
 
-    PGresult* result = PQexec(conn_, query.c_str());
-    ExecStatusType status = PQresultStatus(result);
-
-    if (status != PGRES_TUPLES_OK) {
-        LOG(ERROR) << "Query execution failed: " << PQerrorMessage(conn_);
-        PQclear(result);
+json DatabaseManager::executeQueryParams(const std::string& query, const std::vector<std::string>& params) {
+    ResultPtr result = run(query, &params, true);
+    if (!result) {
         return json::array();
     }
+    return resultToJson(result.get());
+}
+
+bool DatabaseManager::resolveBatch(const QueryBatch& batch,
+                                   std::vector<std::shared_ptr<const PreparedStatement>>& statements,
+                                   std::string& error) const {
+    statements.clear();
+    statements.reserve(batch.size());
 
-    json resultJson = resultToJson(result);
-    PQclear(result);
-    return resultJson;
+    for (const auto& entry : batch.entries()) {
+        if (!entry.prepared) {
+            statements.push_back(nullptr);
+            continue;
+        }
+        auto statement = findStatement(entry.text);
+        if (!statement) {
+            error = "Unknown prepared statement: " + entry.text;
+            return false;
+        }
+        statements.push_back(std::move(statement));
+    }
+    return true;
 }
 
-json DatabaseManager::executeQueryParams(const std::string& query, const std::vector<std::string>& params) {
-    if (!isConnected()) {
-        LOG(ERROR) << "Cannot execute parameterized query: no connection";
-        return json::array();
+std::vector<BatchResult> DatabaseManager::executeBatch(const QueryBatch& batch) {
+    // Report the same failure for every statement when nothing could run
+    auto failAll = [&batch](const std::string& error) {
+        LOG(ERROR) << "Batch execution failed: " << error;
+        std::vector<BatchResult> results(batch.size());
+        for (auto& result : results) {
+            result.error = error;
+        }
+        return results;
+    };
+
+    std::vector<std::shared_ptr<const PreparedStatement>> statements;
+    std::string error;
+    if (!resolveBatch(batch, statements, error)) {
+        return failAll(error);
     }
 
-    // Convert string parameters to char* array
-    std::vector<const char*> paramValues;
-    for (const auto& param : params) {
-        paramValues.push_back(param.c_str());
+    PooledConnection holder;
+    PooledConnection* conn = checkout(holder);
+    if (!conn) {
+        return failAll("no connection");
+    }
+
+    // Blocking mode is fine for the small batches handlers build; the server
+    // reads the whole pipeline before its replies could fill our socket
+    PipelineRun run(conn->connection(), batch, std::move(statements));
+    if (!run.send(error)) {
+        return failAll(error);
+    }
+    if (PQflush(conn->get()) != 0) {
+        return failAll(std::string("Failed to flush batch: ") + PQerrorMessage(conn->get()));
+    }
+
+    while (!run.consume(ResultPtr(PQgetResult(conn->get())))) {
+        if (run.broken() || PQstatus(conn->get()) != CONNECTION_OK) {
+            return failAll(std::string("Lost the pipeline: ") + PQerrorMessage(conn->get()));
+        }
+    }
+    if (run.broken()) {
+        return failAll("Unexpected result sequence from pipelined batch");
+    }
+    return run.finish();
+}
+
+bool DatabaseManager::copyIn(const std::string& copySql, const std::string& data,
+                             std::string* sqlState) {
+    PooledConnection holder;
+    PooledConnection* conn = checkout(holder);
+    if (!conn) {
+        LOG(ERROR) << "Cannot run COPY: no connection";
+        return false;
+    }
+    PGconn* pg = conn->get();
+
+    ResultPtr started(PQexec(pg, copySql.c_str()));
+    if (!started || PQresultStatus(started.get()) != PGRES_COPY_IN) {
+        LOG(ERROR) << "COPY failed to start: " << PQerrorMessage(pg);
+        return false;
+    }
+
+    // Sent in pieces so libpq never holds a second copy of a large batch
+    constexpr size_t kPieceBytes = 64 * 1024;
+    bool sent = true;
+    for (size_t offset = 0; offset < data.size() && sent; offset += kPieceBytes) {
+        size_t length = std::min(kPieceBytes, data.size() - offset);
+        sent = PQputCopyData(pg, data.data() + offset, static_cast<int>(length)) == 1;
+    }
+    if (PQputCopyEnd(pg, sent ? nullptr : "client failed to send data") != 1) {
+        sent = false;
     }
 
-    PGresult* result = PQexecParams(
-        conn_,
-        query.c_str(),
-        static_cast<int>(params.size()),
-        nullptr,  // param types
-        paramValues.data(),
-        nullptr,  // param lengths
-        nullptr,  // param formats
-        0  // result format (0 = text)
-    );
+    // The server rejects the whole COPY if any row is bad
+    bool succeeded = sent;
+    while (PGresult* raw = PQgetResult(pg)) {
+        ResultPtr result(raw);
+        if (PQresultStatus(raw) != PGRES_COMMAND_OK) {
+            succeeded = false;
+            const char* code = PQresultErrorField(raw, PG_DIAG_SQLSTATE);
+            if (sqlState && code) {
+                *sqlState = code;
+            }
+        }
+    }
+    if (!succeeded) {
+        LOG(ERROR) << "COPY failed: " << PQerrorMessage(pg);
+    }
+    return succeeded;
+}
+
+folly::SemiFuture<std::vector<BatchResult>> DatabaseManager::executeBatchAsync(QueryBatch batch,
+                                                                               folly::EventBase* evb) {
+    std::vector<std::shared_ptr<const PreparedStatement>> statements;
+    std::string error;
+    if (!resolveBatch(batch, statements, error)) {
+        return folly::makeSemiFuture<std::vector<BatchResult>>(DatabaseError(error));
+    }
+    if (!pool_) {
+        return folly::makeSemiFuture<std::vector<BatchResult>>(
+            DatabaseError("Cannot execute batch: no connection"));
+    }
+    if (!evb) {
+        evb = folly::EventBaseManager::get()->getEventBase();
+    }
+
+    return pool_->acquireAsync(evb)
+        .via(evb)
+        .thenValue([evb, batch = std::move(batch),
+                    statements = std::move(statements)](PooledConnection conn) mutable {
+            return AsyncBatch::start(evb, std::move(conn), std::move(batch), std::move(statements));
+        })
+        .semi();
+}
 
-    ExecStatusType status = PQresultStatus(result);
+folly::SemiFuture<folly::Unit> DatabaseManager::streamQueryAsync(const std::string& query,
+                                                                 std::vector<std::string> params,
+                                                                 RowChunkCallback onChunk,
+                                                                 std::shared_ptr<StreamControl> control,
+                                                                 folly::EventBase* evb) {
+    if (!pool_) {
+        return folly::makeSemiFuture<folly::Unit>(
+            DatabaseError("Cannot stream query: no connection"));
+    }
+    if (!evb) {
+        evb = folly::EventBaseManager::get()->getEventBase();
+    }
+
+    return pool_->acquireAsync(evb)
+        .via(evb)
+        .thenValue([evb, query, params = std::move(params), onChunk = std::move(onChunk),
+                    control = std::move(control), chunkBytes = streamChunkBytes_](PooledConnection conn) mutable {
+            return RowStream::start(evb, std::move(conn), query, std::move(params),
+                                    std::move(onChunk), std::move(control), chunkBytes);
+        })
+        .semi();
+}
+
+folly::SemiFuture<folly::Unit> DatabaseManager::streamPreparedAsync(const std::string& name,
+                                                                    std::vector<std::string> params,
+                                                                    RowChunkCallback onChunk,
+                                                                    std::shared_ptr<StreamControl> control,
+                                                                    folly::EventBase* evb,
+                                                                    std::shared_ptr<QueryTiming> timing) {
+    auto statement = findStatement(name);
+    if (!statement) {
+        return folly::makeSemiFuture<folly::Unit>(
+            DatabaseError("Unknown prepared statement: " + name));
+    }
+    if (!pool_) {
+        return folly::makeSemiFuture<folly::Unit>(
+            DatabaseError("Cannot stream statement " + name + ": no connection"));
+    }
+    if (!evb) {
+        evb = folly::EventBaseManager::get()->getEventBase();
+    }
+
+    if (timing) {
+        timing->queued = std::chrono::steady_clock::now();
+    }
 
-    if (status != PGRES_TUPLES_OK) {
-        LOG(ERROR) << "Parameterized query execution failed: " << PQerrorMessage(conn_);
-        PQclear(result);
+    return pool_->acquireAsync(evb)
+        .via(evb)
+        .thenValue([evb, statement = std::move(statement), params = std::move(params),
+                    onChunk = std::move(onChunk), control = std::move(control),
+                    chunkBytes = streamChunkBytes_, timing](PooledConnection conn) mutable {
+            auto started = std::chrono::steady_clock::now();
+            size_t histogram = statement->latencyHistogram;
+            if (timing) {
+                timing->acquired = started;
+            }
+            return RowStream::start(evb, std::move(conn), std::move(statement), std::move(params),
+                                    std::move(onChunk), std::move(control), chunkBytes)
+                .deferEnsure([histogram, started, timing] {
+                    recordLatency(histogram, started, timing.get());
+                });
+        })
+        .semi();
+}
+
+folly::SemiFuture<ResultPtr> DatabaseManager::queryAsync(const std::string& query,
+                                                         std::vector<std::string> params,
+                                                         bool expectTuples,
+                                                         folly::EventBase* evb) {
+    if (!pool_) {
+        return folly::makeSemiFuture<ResultPtr>(
+            DatabaseError("Cannot execute query: no connection"));
+    }
+    if (!evb) {
+        evb = folly::EventBaseManager::get()->getEventBase();
+    }
+
+    // The socket must be watched by the loop that continues the request
+    return pool_->acquireAsync(evb)
+        .via(evb)
+        .thenValue([evb, query, params = std::move(params), expectTuples](PooledConnection conn) mutable {
+            return AsyncQuery::start(evb, std::move(conn), query, std::move(params), expectTuples);
+        })
+        .semi();
+}
+
+folly::SemiFuture<folly::Unit> DatabaseManager::executeParamsAsync(const std::string& query,
+                                                                   std::vector<std::string> params,
+                                                                   folly::EventBase* evb) {
+    return queryAsync(query, std::move(params), false, evb)
+        .deferValue([](ResultPtr) { return folly::unit; });
+}
+
+folly::SemiFuture<json> DatabaseManager::executeQueryParamsAsync(const std::string& query,
+                                                                 std::vector<std::string> params,
+                                                                 folly::EventBase* evb) {
+    return queryAsync(query, std::move(params), true, evb)
+        .deferValue([](ResultPtr result) {
+            return getInstance().resultToJson(result.get());
+        });
+}
+
+bool DatabaseManager::executePrepared(const std::string& name, const std::vector<std::string>& params) {
+    auto statement = findStatement(name);
+    if (!statement) {
+        LOG(ERROR) << "Unknown prepared statement: " << name;
+        return false;
+    }
+    return runPrepared(*statement, params, false) != nullptr;
+}
+
+json DatabaseManager::executeQueryPrepared(const std::string& name, const std::vector<std::string>& params) {
+    auto statement = findStatement(name);
+    if (!statement) {
+        LOG(ERROR) << "Unknown prepared statement: " << name;
         return json::array();
     }
 
-    json resultJson = resultToJson(result);
-    PQclear(result);
-    return resultJson;
+    ResultPtr result = runPrepared(*statement, params, true);
+    if (!result) {
+        return json::array();
+    }
+    return resultToJson(result.get());
+}
+
+bool DatabaseManager::cacheResults(const std::string& name,
+                                   const std::vector<std::string>& tables) {
+    if (!findStatement(name)) {
+        LOG(ERROR) << "Cannot cache results of unknown statement " << name;
+        return false;
+    }
+    if (resultCache_) {
+        resultCache_->cacheStatement(name, tables);
+    }
+    return true;
+}
+
+folly::SemiFuture<std::unique_ptr<folly::IOBuf>> DatabaseManager::cachedPreparedAsync(
+    const std::string& name,
+    std::vector<std::string> params,
+    ResultSerializer serialize,
+    folly::EventBase* evb,
+    std::shared_ptr<QueryTiming> timing) {
+    std::shared_ptr<ResultCache> cache = resultCache_;
+    if (!cache || !cache->caches(name)) {
+        return preparedAsync(name, std::move(params), true, evb, std::move(timing))
+            .deferValue([serialize = std::move(serialize)](ResultPtr result) {
+                return serialize(result.get());
+            });
+    }
+
+    // Taken before the query, so a change committed while it runs leaves
+    // the stored bytes stale at once
+    std::string key = ResultCache::key(name, params);
+    uint64_t generation = cache->generation(name);
+    if (auto body = cache->lookup(key, generation)) {
+        return folly::makeSemiFuture(std::move(body));
+    }
+
+    return preparedAsync(name, std::move(params), true, evb, std::move(timing))
+        .deferValue([cache, key = std::move(key), generation,
+                     serialize = std::move(serialize)](ResultPtr result) {
+            auto body = serialize(result.get());
+            if (body) {
+                cache->store(key, generation, *body);
+            }
+            return body;
+        });
+}
+
+folly::SemiFuture<ResultPtr> DatabaseManager::preparedAsync(const std::string& name,
+                                                            std::vector<std::string> params,
+                                                            bool expectTuples,
+                                                            folly::EventBase* evb,
+                                                            std::shared_ptr<QueryTiming> timing) {
+    auto statement = findStatement(name);
+    if (!statement) {
+        return folly::makeSemiFuture<ResultPtr>(
+            DatabaseError("Unknown prepared statement: " + name));
+    }
+    if (!pool_) {
+        return folly::makeSemiFuture<ResultPtr>(
+            DatabaseError("Cannot execute statement " + name + ": no connection"));
+    }
+    if (!evb) {
+        evb = folly::EventBaseManager::get()->getEventBase();
+    }
+
+    if (timing) {
+        timing->queued = std::chrono::steady_clock::now();
+    }
+
+    return pool_->acquireAsync(evb)
+        .via(evb)
+        .thenValue([evb, statement = std::move(statement), params = std::move(params),
+                    expectTuples, timing](PooledConnection conn) mutable {
+            auto started = std::chrono::steady_clock::now();
+            size_t histogram = statement->latencyHistogram;
+            if (timing) {
+                timing->acquired = started;
+            }
+            return AsyncQuery::start(evb, std::move(conn), std::move(statement),
+                                     std::move(params), expectTuples)
+                .deferEnsure([histogram, started, timing] {
+                    recordLatency(histogram, started, timing.get());
+                });
+        })
+        .semi();
+}
+
+folly::SemiFuture<folly::Unit> DatabaseManager::executePreparedAsync(const std::string& name,
+                                                                     std::vector<std::string> params,
+                                                                     folly::EventBase* evb,
+                                                                     std::shared_ptr<QueryTiming> timing) {
+    return preparedAsync(name, std::move(params), false, evb, std::move(timing))
+        .deferValue([](ResultPtr) { return folly::unit; });
+}
+
+folly::SemiFuture<json> DatabaseManager::executeQueryPreparedAsync(const std::string& name,
+                                                                   std::vector<std::string> params,
+                                                                   folly::EventBase* evb) {
+    return preparedAsync(name, std::move(params), true, evb)
+        .deferValue([](ResultPtr result) {
+            return getInstance().resultToJson(result.get());
+        });
 }
 
 bool DatabaseManager::beginTransaction() {
-    return execute("BEGIN TRANSACTION");
+    if (tlsTransactionConn) {
+        LOG(ERROR) << "Transaction already in progress on this thread";
+        return false;
+    }
+    if (!pool_ || !(tlsTransactionConn = pool_->acquire())) {
+        LOG(ERROR) << "Cannot begin transaction: no connection";
+        return false;
+    }
+
+    if (!execute("BEGIN TRANSACTION")) {
+        tlsTransactionConn.release();
+        return false;
+    }
+    return true;
 }
 
 bool DatabaseManager::commitTransaction() {
-    return execute("COMMIT");
+    if (!tlsTransactionConn) {
+        LOG(ERROR) << "Cannot commit: no transaction in progress";
+        return false;
+    }
+    bool ok = execute("COMMIT");
+    tlsTransactionConn.release();
+    return ok;
 }
 
 bool DatabaseManager::rollbackTransaction() {
-    return execute("ROLLBACK");
+    if (!tlsTransactionConn) {
+        LOG(ERROR) << "Cannot roll back: no transaction in progress";
+        return false;
+    }
+    bool ok = execute("ROLLBACK");
+    tlsTransactionConn.release();
+    return ok;
 }
 
 json DatabaseManager::resultToJson(PGresult* result) {
-    json jsonArray = json::array();
-
-    // Get number of rows and columns
-    int rows = PQntuples(result);
-    int cols = PQnfields(result);
-
-    // Get column names
-    std::vector<std::string> columnNames;
-    for (int col = 0; col < cols; col++) {
-        columnNames.push_back(PQfname(result, col));
-    }
-
-    // Iterate through rows
-    for (int row = 0; row < rows; row++) {
-        json jsonRow = json::object();
-
-        // Iterate through columns
-        for (int col = 0; col < cols; col++) {
-            // Check if the value is NULL
-            if (PQgetisnull(result, row, col)) {
-                jsonRow[columnNames[col]] = nullptr;
-            } else {
-                // Get the value as a string
-                const char* value = PQgetvalue(result, row, col);
-                jsonRow[columnNames[col]] = value;
-            }
-        }
-
-        jsonArray.push_back(jsonRow);
-    }
-
-    return jsonArray;
+    return ResultConverter::toJson(result);
 }
 
 } // namespace db
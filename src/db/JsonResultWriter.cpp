@@ -0,0 +1,231 @@
+#include "db/JsonResultWriter.h"
+#include "db/PgTypes.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+namespace securapp {
+namespace db {
+
+namespace {
+
+// Escape the contents of a JSON string, handing unescaped runs and escape
+// sequences to 'sink(data, length)'
+template <class Sink>
+void escapeJson(const char* data, size_t length, Sink&& sink) {
+    static const char* hex = "0123456789abcdef";
+
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        sink(data + start, i - start);
+        start = i + 1;
+
+        switch (c) {
+            case '"': sink("\\\"", 2); break;
+            case '\\': sink("\\\\", 2); break;
+            case '\n': sink("\\n", 2); break;
+            case '\r': sink("\\r", 2); break;
+            case '\t': sink("\\t", 2); break;
+            case '\b': sink("\\b", 2); break;
+            case '\f': sink("\\f", 2); break;
+            default: {
+                char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F]};
+                sink(escaped, sizeof(escaped));
+                break;
+            }
+        }
+    }
+    sink(data + start, length - start);
+}
+
+// Text-format floats JSON cannot represent ("NaN", "Infinity"); 'text' is
+// NUL-terminated
+bool isJsonNumber(const char* text, size_t length) {
+    return length > 0 && std::isfinite(std::strtod(text, nullptr));
+}
+
+} // namespace
+
+JsonResultWriter::JsonResultWriter(size_t growth)
+    : appender_(&queue_, growth) {}
+
+void JsonResultWriter::writeRaw(folly::StringPiece text) {
+    push(text.data(), text.size());
+}
+
+void JsonResultWriter::writeString(folly::StringPiece text) {
+    push("\"", 1);
+    writeEscaped(text.data(), text.size());
+    push("\"", 1);
+}
+
+std::unique_ptr<folly::IOBuf> JsonResultWriter::finish() {
+    return queue_.move();
+}
+
+std::unique_ptr<folly::IOBuf> JsonResultWriter::toIOBuf(const PGresult* result) {
+    JsonResultWriter writer;
+    writer.writeRows(result);
+    return writer.finish();
+}
+
+JsonResultWriter::RowLayout JsonResultWriter::layout(const PGresult* result) {
+    RowLayout layout;
+    layout.columns = ResultConverter::describe(result);
+    const auto& columns = layout.columns;
+
+    // Duplicate column names resolve to the last one, like ResultConverter
+    std::unordered_map<std::string, size_t> lastIndex;
+    for (size_t i = 0; i < columns.size(); i++) {
+        lastIndex[columns[i].name] = i;
+    }
+
+    layout.keys.resize(columns.size());
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (lastIndex[columns[i].name] != i) {
+            continue;
+        }
+        const std::string& name = columns[i].name;
+        std::string& key = layout.keys[i];
+        key.reserve(name.size() + 3);
+        key += '"';
+        escapeJson(name.data(), name.size(), [&key](const char* data, size_t length) {
+            key.append(data, length);
+        });
+        key += "\":";
+    }
+    return layout;
+}
+
+void JsonResultWriter::writeRows(const PGresult* result) {
+    int rows = PQntuples(result);
+
+    push("[", 1);
+    if (rows > 0) {
+        RowLayout rowLayout = layout(result);
+        for (int row = 0; row < rows; row++) {
+            if (row > 0) {
+                push(",", 1);
+            }
+            writeRow(result, row, rowLayout);
+        }
+    }
+    push("]", 1);
+}
+
+void JsonResultWriter::writeRow(const PGresult* result, int row, const RowLayout& layout) {
+    push("{", 1);
+
+    bool first = true;
+    for (size_t col = 0; col < layout.keys.size(); col++) {
+        const std::string& key = layout.keys[col];
+        if (key.empty()) {
+            continue;
+        }
+        if (!first) {
+            push(",", 1);
+        }
+        first = false;
+        push(key.data(), key.size());
+
+        int column = static_cast<int>(col);
+        if (PQgetisnull(result, row, column)) {
+            push("null", 4);
+        } else {
+            writeCell(result, row, column, layout.columns[col]);
+        }
+    }
+    push("}", 1);
+}
+
+void JsonResultWriter::writeCell(const PGresult* result, int row, int col, const ColumnInfo& column) {
+    const char* value = PQgetvalue(result, row, col);
+    size_t length = static_cast<size_t>(PQgetlength(result, row, col));
+
+    if (column.binary) {
+        if (column.kind == ColumnKind::Json) {
+            // Embedded as-is; jsonb carries a leading version byte
+            if (column.type == pgtype::kJsonb && length > 0) {
+                push(value + 1, length - 1);
+            } else {
+                push(value, length);
+            }
+            return;
+        }
+
+        scratch_.clear();
+        if (!ResultConverter::binaryToText(column.type, value, length, scratch_)) {
+            // Same bytea-style hex as ResultConverter
+            static const char* hex = "0123456789abcdef";
+            scratch_ = "\\x";
+            for (size_t i = 0; i < length; i++) {
+                unsigned char c = static_cast<unsigned char>(value[i]);
+                scratch_ += hex[c >> 4];
+                scratch_ += hex[c & 0x0F];
+            }
+            writeString(scratch_);
+            return;
+        }
+        value = scratch_.data();
+        length = scratch_.size();
+    }
+
+    switch (column.kind) {
+        case ColumnKind::Integer:
+            push(value, length);
+            return;
+        case ColumnKind::Float:
+            if (isJsonNumber(value, length)) {
+                push(value, length);
+            } else {
+                writeString(folly::StringPiece(value, length));
+            }
+            return;
+        case ColumnKind::Bool:
+            if (length > 0 && value[0] == 't') {
+                push("true", 4);
+            } else {
+                push("false", 5);
+            }
+            return;
+        case ColumnKind::Json:
+            // The server only stores valid JSON
+            push(value, length);
+            return;
+        case ColumnKind::Timestamp: {
+            // "2023-01-01 00:00:00" -> "2023-01-01T00:00:00"
+            push("\"", 1);
+            const char* space = static_cast<const char*>(std::memchr(value, ' ', length));
+            if (space) {
+                size_t head = static_cast<size_t>(space - value);
+                writeEscaped(value, head);
+                push("T", 1);
+                writeEscaped(space + 1, length - head - 1);
+            } else {
+                writeEscaped(value, length);
+            }
+            push("\"", 1);
+            return;
+        }
+        case ColumnKind::Numeric:
+        case ColumnKind::Text:
+        default:
+            writeString(folly::StringPiece(value, length));
+            return;
+    }
+}
+
+void JsonResultWriter::writeEscaped(const char* data, size_t length) {
+    escapeJson(data, length, [this](const char* run, size_t runLength) {
+        push(run, runLength);
+    });
+}
+
+} // namespace db
+} // namespace securapp
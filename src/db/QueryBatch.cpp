@@ -0,0 +1,167 @@
+#include "db/QueryBatch.h"
+#include <glog/logging.h>
+#include <unordered_set>
+
+namespace securapp {
+namespace db {
+
+QueryBatch& QueryBatch::add(std::string query, std::vector<std::string> params, bool expectTuples) {
+    entries_.push_back(Entry{std::move(query), false, std::move(params), expectTuples});
+    return *this;
+}
+
+QueryBatch& QueryBatch::addPrepared(std::string name, std::vector<std::string> params,
+                                    bool expectTuples) {
+    entries_.push_back(Entry{std::move(name), true, std::move(params), expectTuples});
+    return *this;
+}
+
+PipelineRun::PipelineRun(PgConnection* session,
+                         const QueryBatch& batch,
+                         std::vector<std::shared_ptr<const PreparedStatement>> statements)
+    : session_(session),
+      batch_(batch),
+      statements_(std::move(statements)),
+      results_(batch.size()) {}
+
+bool PipelineRun::send(std::string& error) {
+    PGconn* pg = session_->get();
+
+    if (!PQenterPipelineMode(pg)) {
+        error = std::string("Cannot enter pipeline mode: ") + PQerrorMessage(pg);
+        return false;
+    }
+
+    // Statements first used by this batch are prepared inside the pipeline
+    std::unordered_set<std::string> preparing;
+    const auto& entries = batch_.entries();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto& entry = entries[i];
+
+        // Convert string parameters to char* array; libpq copies them
+        std::vector<const char*> paramValues;
+        paramValues.reserve(entry.params.size());
+        for (const auto& param : entry.params) {
+            paramValues.push_back(param.c_str());
+        }
+
+        int sent;
+        if (const auto& statement = statements_[i]) {
+            if (!session_->isPrepared(statement->name) && preparing.insert(statement->name).second) {
+                if (!PQsendPrepare(pg, statement->name.c_str(), statement->sql.c_str(),
+                                   static_cast<int>(statement->paramTypes.size()),
+                                   statement->paramTypes.empty() ? nullptr : statement->paramTypes.data())) {
+                    error = "Failed to queue prepare of " + statement->name + ": " + PQerrorMessage(pg);
+                    return false;
+                }
+                plan_.push_back(Step{true, i});
+            }
+
+            sent = PQsendQueryPrepared(
+                pg,
+                statement->name.c_str(),
+                static_cast<int>(paramValues.size()),
+                paramValues.data(),
+                nullptr,  // param lengths
+                nullptr,  // param formats
+                statement->resultFormat()
+            );
+        } else {
+            sent = PQsendQueryParams(
+                pg,
+                entry.text.c_str(),
+                static_cast<int>(paramValues.size()),
+                nullptr,  // param types
+                paramValues.data(),
+                nullptr,  // param lengths
+                nullptr,  // param formats
+                0  // result format (0 = text)
+            );
+        }
+
+        if (!sent) {
+            error = std::string("Failed to queue batch statement: ") + PQerrorMessage(pg);
+            return false;
+        }
+        plan_.push_back(Step{false, i});
+    }
+
+    if (!PQpipelineSync(pg)) {
+        error = std::string("Failed to queue pipeline sync: ") + PQerrorMessage(pg);
+        return false;
+    }
+    return true;
+}
+
+bool PipelineRun::consume(ResultPtr result) {
+    if (!result) {
+        finishStep();
+        return false;
+    }
+
+    if (PQresultStatus(result.get()) == PGRES_PIPELINE_SYNC) {
+        if (cursor_ != plan_.size()) {
+            broken_ = true;
+        }
+        return true;
+    }
+
+    // Keep the first error, otherwise the last result
+    if (!current_ || resultSucceeded(current_.get(), false)) {
+        current_ = std::move(result);
+    }
+    return false;
+}
+
+void PipelineRun::finishStep() {
+    if (cursor_ >= plan_.size()) {
+        // More command boundaries than commands sent
+        broken_ = true;
+        return;
+    }
+
+    const Step& step = plan_[cursor_++];
+    const auto& entry = batch_.entries()[step.entry];
+    BatchResult& out = results_[step.entry];
+    ResultPtr result = std::move(current_);
+
+    if (step.prepare) {
+        const auto& statement = statements_[step.entry];
+        if (resultSucceeded(result.get(), false)) {
+            session_->markPrepared(statement->name);
+        } else {
+            out.error = "Failed to prepare statement " + statement->name + ": " +
+                        (result ? PQresultErrorMessage(result.get()) : "no result");
+        }
+        return;
+    }
+
+    if (!out.error.empty()) {
+        // The prepare for this statement already failed
+        return;
+    }
+
+    if (result && PQresultStatus(result.get()) == PGRES_PIPELINE_ABORTED) {
+        out.error = "Skipped: an earlier statement in the batch failed";
+    } else if (resultSucceeded(result.get(), entry.expectTuples)) {
+        out.ok = true;
+        out.result = std::move(result);
+    } else {
+        out.error = result ? PQresultErrorMessage(result.get()) : "no result";
+        if (statements_[step.entry] && hasSqlState(result.get(), kSqlStateUndefinedStatement)) {
+            // Lost on the server; prepare again next time
+            session_->forgetPrepared(statements_[step.entry]->name);
+        }
+    }
+}
+
+std::vector<BatchResult> PipelineRun::finish() {
+    if (!PQexitPipelineMode(session_->get())) {
+        LOG(WARNING) << "Failed to leave pipeline mode: " << PQerrorMessage(session_->get());
+    }
+    return std::move(results_);
+}
+
+} // namespace db
+} // namespace securapp
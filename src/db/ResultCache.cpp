@@ -0,0 +1,269 @@
+#include "db/ResultCache.h"
+#include "db/PgResult.h"
+#include "util/Metrics.h"
+
+#include <glog/logging.h>
+#include <postgresql/libpq-fe.h>
+#include <poll.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+
+namespace securapp {
+namespace db {
+
+namespace {
+
+// How often the listener checks for shutdown while the channel is quiet
+constexpr int kPollTimeoutMs = 250;
+
+// Pause between attempts to reconnect the listener
+constexpr std::chrono::milliseconds kReconnectDelay{1000};
+
+} // namespace
+
+ResultCacheOptions ResultCacheOptions::fromConfig(const json& cacheConfig) {
+    ResultCacheOptions options;
+    options.enabled = cacheConfig.value("enabled", options.enabled);
+    options.maxBytes = cacheConfig.value("max_bytes", options.maxBytes);
+    options.maxEntries = cacheConfig.value("max_entries", options.maxEntries);
+    options.channel = cacheConfig.value("channel", options.channel);
+    return options;
+}
+
+ResultCache::ResultCache(const ResultCacheOptions& options)
+    : options_(options),
+      shardBytes_(std::max<size_t>(options.maxBytes / kShards, 1)) {
+    size_t shardCapacity = std::max<size_t>(options_.maxEntries / kShards, 1);
+    for (auto& shard : shards_) {
+        shard = std::make_unique<Shard>(shardCapacity);
+    }
+
+    auto& metrics = util::Metrics::getInstance();
+    hitCounter_ = metrics.counter("result_cache_hits_total", "",
+        "Statement calls answered from the result cache");
+    missCounter_ = metrics.counter("result_cache_misses_total", "",
+        "Cacheable statement calls that ran the query");
+    invalidationCounter_ = metrics.counter("result_cache_invalidations_total", "",
+        "Table change notifications received");
+}
+
+ResultCache::~ResultCache() {
+    stop();
+}
+
+void ResultCache::start(const std::string& connStr) {
+    if (listener_.joinable()) {
+        return;
+    }
+    stopping_.store(false);
+    listener_ = std::thread([this, connStr] { listenLoop(connStr); });
+}
+
+void ResultCache::stop() {
+    if (!listener_.joinable()) {
+        return;
+    }
+    stopping_.store(true);
+    listener_.join();
+    listening_.store(false);
+}
+
+void ResultCache::cacheStatement(const std::string& statement,
+                                 const std::vector<std::string>& tables) {
+    if (listener_.joinable()) {
+        LOG(DFATAL) << "Cannot cache " << statement << ": the result cache is already listening";
+        return;
+    }
+
+    auto& generations = policies_[statement];
+    generations.clear();
+    for (const auto& name : tables) {
+        generations.push_back(table(name));
+    }
+}
+
+uint64_t ResultCache::generation(const std::string& statement) const {
+    // Generations only grow, so their sum changes whenever any of them does
+    uint64_t sum = 0;
+    auto it = policies_.find(statement);
+    if (it != policies_.end()) {
+        for (const Generation* generation : it->second) {
+            sum += generation->load(std::memory_order_acquire);
+        }
+    }
+    return sum;
+}
+
+std::string ResultCache::key(const std::string& statement, const std::vector<std::string>& params) {
+    // Length-prefixed, so no two parameter lists share a key
+    std::string key = statement;
+    for (const auto& param : params) {
+        key += '\0';
+        key += std::to_string(param.size());
+        key += ':';
+        key += param;
+    }
+    return key;
+}
+
+std::unique_ptr<folly::IOBuf> ResultCache::lookup(const std::string& key, uint64_t generation) {
+    auto& metrics = util::Metrics::getInstance();
+    if (!listening_.load(std::memory_order_acquire)) {
+        metrics.add(missCounter_);
+        return nullptr;
+    }
+
+    uint64_t hash = std::hash<std::string>()(key);
+    Shard& shard = shardFor(hash);
+    std::unique_ptr<folly::IOBuf> body;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Entry* entry = shard.entries.find(hash);
+        if (entry && entry->key == key) {
+            if (entry->generation == generation) {
+                body = entry->body->clone();
+            } else if (entry->generation < generation) {
+                // Stale; give its memory back now rather than on eviction
+                shard.bytes -= entry->bytes;
+                shard.entries.erase(hash);
+            }
+        }
+    }
+
+    metrics.add(body ? hitCounter_ : missCounter_);
+    return body;
+}
+
+void ResultCache::store(const std::string& key, uint64_t generation, const folly::IOBuf& body) {
+    if (!listening_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    size_t length = body.computeChainDataLength();
+    size_t bytes = length + key.size() + sizeof(Entry);
+    if (bytes > shardBytes_) {
+        return;
+    }
+
+    // Exact-size copy made outside the lock; the writer's buffers usually
+    // have plenty of unused room that the cache would otherwise hold on to
+    auto copy = folly::IOBuf::create(length);
+    for (auto range : body) {
+        std::memcpy(copy->writableTail(), range.data(), range.size());
+        copy->append(range.size());
+    }
+
+    uint64_t hash = std::hash<std::string>()(key);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // A reused slot still holds the entry it replaces; a colliding key
+    // simply takes the slot over
+    bool inserted;
+    Entry& entry = shard.entries.findOrInsert(hash, inserted);
+    shard.bytes -= entry.bytes;
+    entry.key = key;
+    entry.generation = generation;
+    entry.body = std::move(copy);
+    entry.bytes = bytes;
+    shard.bytes += bytes;
+
+    uint64_t oldestKey;
+    while (shard.bytes > shardBytes_) {
+        Entry* oldest = shard.entries.oldest(oldestKey);
+        if (!oldest || oldest == &entry) {
+            break;
+        }
+        shard.bytes -= oldest->bytes;
+        shard.entries.erase(oldestKey);
+    }
+}
+
+void ResultCache::invalidateAll() {
+    for (auto& table : tables_) {
+        table.second->fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+ResultCache::Generation* ResultCache::table(const std::string& name) {
+    auto& generation = tables_[name];
+    if (!generation) {
+        generation = std::make_unique<Generation>(0);
+    }
+    return generation.get();
+}
+
+void ResultCache::tableChanged(const std::string& name) {
+    auto it = tables_.find(name);
+    if (it != tables_.end()) {
+        it->second->fetch_add(1, std::memory_order_acq_rel);
+        util::Metrics::getInstance().add(invalidationCounter_);
+    }
+}
+
+void ResultCache::listenLoop(std::string connStr) {
+    auto pause = [this] {
+        auto until = std::chrono::steady_clock::now() + kReconnectDelay;
+        while (!stopping_.load() && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPollTimeoutMs));
+        }
+    };
+
+    while (!stopping_.load()) {
+        PGconn* conn = PQconnectdb(connStr.c_str());
+        if (PQstatus(conn) != CONNECTION_OK) {
+            LOG(WARNING) << "Result cache listener cannot connect: " << PQerrorMessage(conn);
+            PQfinish(conn);
+            pause();
+            continue;
+        }
+
+        std::string listen = "LISTEN ";
+        if (char* channel = PQescapeIdentifier(conn, options_.channel.data(), options_.channel.size())) {
+            listen += channel;
+            PQfreemem(channel);
+        }
+        ResultPtr result(PQexec(conn, listen.c_str()));
+        if (!resultSucceeded(result.get(), false)) {
+            LOG(ERROR) << "Result cache listener failed to " << listen << ": " << PQerrorMessage(conn);
+            PQfinish(conn);
+            pause();
+            continue;
+        }
+
+        // Whatever changed while nobody listened has to be read again
+        invalidateAll();
+        listening_.store(true, std::memory_order_release);
+        LOG(INFO) << "Result cache listening for changes on " << options_.channel;
+
+        while (!stopping_.load()) {
+            pollfd fd = {PQsocket(conn), POLLIN, 0};
+            int ready = poll(&fd, 1, kPollTimeoutMs);
+            if (ready < 0 && errno != EINTR) {
+                break;
+            }
+            if (ready > 0 && !PQconsumeInput(conn)) {
+                break;
+            }
+            while (PGnotify* notify = PQnotifies(conn)) {
+                tableChanged(notify->extra);
+                PQfreemem(notify);
+            }
+            if (PQstatus(conn) != CONNECTION_OK) {
+                break;
+            }
+        }
+
+        listening_.store(false, std::memory_order_release);
+        PQfinish(conn);
+        if (!stopping_.load()) {
+            LOG(WARNING) << "Result cache listener disconnected; caching paused until it reconnects";
+            pause();
+        }
+    }
+}
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,418 @@
+#include "db/ResultConverter.h"
+#include "db/PgTypes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace securapp {
+namespace db {
+
+namespace {
+
+// Type OIDs without a constant in PgTypes.h
+constexpr Oid kNameOid = 19;
+constexpr Oid kBpcharOid = 1042;
+
+// Days between 1970-01-01 and the PostgreSQL epoch 2000-01-01
+constexpr int64_t kPgEpochDays = 10957;
+constexpr int64_t kUsecPerDay = 86400LL * 1000000LL;
+
+// Proleptic Gregorian date from days since 1970-01-01
+void civilFromDays(int64_t z, int64_t& year, unsigned& month, unsigned& day) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2 ? 1 : 0);
+}
+
+void appendDate(int64_t pgDays, std::string& out) {
+    int64_t year;
+    unsigned month, day;
+    civilFromDays(pgDays + kPgEpochDays, year, month, day);
+
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%04lld-%02u-%02u",
+                          static_cast<long long>(year), month, day);
+    out.append(buf, static_cast<size_t>(n));
+}
+
+// Microseconds since 2000-01-01 as ISO 8601 (UTC for timestamptz)
+void appendTimestamp(int64_t usec, bool withTimeZone, std::string& out) {
+    if (usec == std::numeric_limits<int64_t>::max()) {
+        out += "infinity";
+        return;
+    }
+    if (usec == std::numeric_limits<int64_t>::min()) {
+        out += "-infinity";
+        return;
+    }
+
+    int64_t days = usec / kUsecPerDay;
+    int64_t rem = usec % kUsecPerDay;
+    if (rem < 0) {
+        rem += kUsecPerDay;
+        days--;
+    }
+
+    appendDate(days, out);
+
+    int64_t secs = rem / 1000000;
+    int64_t frac = rem % 1000000;
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "T%02lld:%02lld:%02lld",
+                          static_cast<long long>(secs / 3600),
+                          static_cast<long long>((secs / 60) % 60),
+                          static_cast<long long>(secs % 60));
+    out.append(buf, static_cast<size_t>(n));
+
+    if (frac != 0) {
+        n = std::snprintf(buf, sizeof(buf), ".%06lld", static_cast<long long>(frac));
+        // Drop trailing zeros like the server does
+        while (n > 1 && buf[n - 1] == '0') {
+            n--;
+        }
+        out.append(buf, static_cast<size_t>(n));
+    }
+
+    if (withTimeZone) {
+        out += 'Z';
+    }
+}
+
+// Binary numeric: ndigits, weight, sign, dscale, then base-10000 digits
+bool appendNumeric(const char* data, size_t length, std::string& out) {
+    if (length < 8) {
+        return false;
+    }
+
+    int ndigits = static_cast<int>(ResultConverter::readInt(data, 2));
+    int weight = static_cast<int>(ResultConverter::readInt(data + 2, 2));
+    uint16_t sign = static_cast<uint16_t>(ResultConverter::readInt(data + 4, 2));
+    int dscale = static_cast<int>(ResultConverter::readInt(data + 6, 2));
+
+    if (length < 8 + static_cast<size_t>(ndigits) * 2) {
+        return false;
+    }
+
+    switch (sign) {
+        case 0xC000: out += "NaN"; return true;
+        case 0xD000: out += "Infinity"; return true;
+        case 0xF000: out += "-Infinity"; return true;
+        case 0x4000: out += '-'; break;
+        default: break;
+    }
+
+    auto digit = [&](int i) -> int {
+        return (i >= 0 && i < ndigits)
+            ? static_cast<int>(ResultConverter::readInt(data + 8 + i * 2, 2))
+            : 0;
+    };
+
+    char buf[8];
+    if (weight < 0) {
+        out += '0';
+    } else {
+        for (int i = 0; i <= weight; i++) {
+            int n = std::snprintf(buf, sizeof(buf), i == 0 ? "%d" : "%04d", digit(i));
+            out.append(buf, static_cast<size_t>(n));
+        }
+    }
+
+    if (dscale > 0) {
+        out += '.';
+        int written = 0;
+        for (int i = weight + 1; written < dscale; i++) {
+            std::snprintf(buf, sizeof(buf), "%04d", digit(i));
+            int take = std::min(4, dscale - written);
+            out.append(buf, static_cast<size_t>(take));
+            written += take;
+        }
+    }
+    return true;
+}
+
+void appendUuid(const unsigned char* bytes, std::string& out) {
+    static const char* hex = "0123456789abcdef";
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            out += '-';
+        }
+        out += hex[bytes[i] >> 4];
+        out += hex[bytes[i] & 0x0F];
+    }
+}
+
+// bytea-style hex for values we cannot decode
+std::string toHex(const char* data, size_t length) {
+    static const char* hex = "0123456789abcdef";
+    std::string out = "\\x";
+    out.reserve(2 + length * 2);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        out += hex[c >> 4];
+        out += hex[c & 0x0F];
+    }
+    return out;
+}
+
+// Floats that JSON cannot represent are kept as strings
+json floatToJson(double value, const char* text, size_t length) {
+    if (std::isfinite(value)) {
+        return value;
+    }
+    return std::string(text, length);
+}
+
+json parseEmbeddedJson(const char* data, size_t length) {
+    json value = json::parse(data, data + length, nullptr, false);
+    if (value.is_discarded()) {
+        return std::string(data, length);
+    }
+    return value;
+}
+
+} // namespace
+
+int64_t ResultConverter::readInt(const char* data, size_t length) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; i++) {
+        value = (value << 8) | static_cast<unsigned char>(data[i]);
+    }
+    // Sign-extend narrower integers
+    if (length > 0 && length < 8 && (static_cast<unsigned char>(data[0]) & 0x80)) {
+        value |= ~uint64_t(0) << (length * 8);
+    }
+    return static_cast<int64_t>(value);
+}
+
+ColumnKind ResultConverter::kindOf(Oid type) {
+    switch (type) {
+        case pgtype::kInt2:
+        case pgtype::kInt4:
+        case pgtype::kInt8:
+        case pgtype::kOid:
+            return ColumnKind::Integer;
+        case pgtype::kFloat4:
+        case pgtype::kFloat8:
+            return ColumnKind::Float;
+        case pgtype::kBool:
+            return ColumnKind::Bool;
+        case pgtype::kNumeric:
+            return ColumnKind::Numeric;
+        case pgtype::kJson:
+        case pgtype::kJsonb:
+            return ColumnKind::Json;
+        case pgtype::kTimestamp:
+        case pgtype::kTimestampTz:
+        case pgtype::kDate:
+            return ColumnKind::Timestamp;
+        default:
+            return ColumnKind::Text;
+    }
+}
+
+std::vector<ColumnInfo> ResultConverter::describe(const PGresult* result) {
+    int cols = PQnfields(result);
+
+    std::vector<ColumnInfo> columns;
+    columns.reserve(static_cast<size_t>(cols));
+    for (int col = 0; col < cols; col++) {
+        Oid type = PQftype(result, col);
+        columns.push_back(ColumnInfo{PQfname(result, col), type, kindOf(type),
+                                     PQfformat(result, col) == 1});
+    }
+    return columns;
+}
+
+bool ResultConverter::binaryToText(Oid type, const char* data, size_t length, std::string& out) {
+    switch (type) {
+        case pgtype::kText:
+        case pgtype::kVarchar:
+        case pgtype::kJson:
+        case kNameOid:
+        case kBpcharOid:
+            out.append(data, length);
+            return true;
+        case pgtype::kJsonb:
+            // Version byte followed by the JSON text
+            if (length < 1) {
+                return false;
+            }
+            out.append(data + 1, length - 1);
+            return true;
+        case pgtype::kInt2:
+        case pgtype::kInt4:
+        case pgtype::kInt8:
+        case pgtype::kOid:
+            out += std::to_string(type == pgtype::kOid
+                ? static_cast<int64_t>(static_cast<uint32_t>(readInt(data, length)))
+                : readInt(data, length));
+            return true;
+        case pgtype::kBool:
+            out += (length > 0 && data[0]) ? "t" : "f";
+            return true;
+        case pgtype::kFloat4:
+        case pgtype::kFloat8: {
+            double value;
+            if (length == 4) {
+                uint32_t bits = static_cast<uint32_t>(readInt(data, 4));
+                float f;
+                std::memcpy(&f, &bits, sizeof(f));
+                value = f;
+            } else if (length == 8) {
+                uint64_t bits = static_cast<uint64_t>(readInt(data, 8));
+                std::memcpy(&value, &bits, sizeof(value));
+            } else {
+                return false;
+            }
+            char buf[32];
+            int n = std::snprintf(buf, sizeof(buf), "%.17g", value);
+            out.append(buf, static_cast<size_t>(n));
+            return true;
+        }
+        case pgtype::kTimestamp:
+        case pgtype::kTimestampTz:
+            if (length != 8) {
+                return false;
+            }
+            appendTimestamp(readInt(data, 8), type == pgtype::kTimestampTz, out);
+            return true;
+        case pgtype::kDate:
+            if (length != 4) {
+                return false;
+            }
+            appendDate(readInt(data, 4), out);
+            return true;
+        case pgtype::kNumeric:
+            return appendNumeric(data, length, out);
+        case pgtype::kUuid:
+            if (length != 16) {
+                return false;
+            }
+            appendUuid(reinterpret_cast<const unsigned char*>(data), out);
+            return true;
+        default:
+            return false;
+    }
+}
+
+json ResultConverter::cellToJson(const PGresult* result, int row, int col, const ColumnInfo& column) {
+    const char* value = PQgetvalue(result, row, col);
+    size_t length = static_cast<size_t>(PQgetlength(result, row, col));
+
+    if (column.binary) {
+        switch (column.kind) {
+            case ColumnKind::Integer:
+                if (column.type == pgtype::kOid) {
+                    return static_cast<uint32_t>(readInt(value, length));
+                }
+                return readInt(value, length);
+            case ColumnKind::Bool:
+                return length > 0 && value[0] != 0;
+            case ColumnKind::Json:
+                if (column.type == pgtype::kJsonb && length > 0) {
+                    return parseEmbeddedJson(value + 1, length - 1);
+                }
+                return parseEmbeddedJson(value, length);
+            default: {
+                std::string text;
+                if (!binaryToText(column.type, value, length, text)) {
+                    return toHex(value, length);
+                }
+                if (column.kind == ColumnKind::Float) {
+                    return floatToJson(std::strtod(text.c_str(), nullptr), text.data(), text.size());
+                }
+                return text;
+            }
+        }
+    }
+
+    switch (column.kind) {
+        case ColumnKind::Integer:
+            if (column.type == pgtype::kOid) {
+                return static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            return static_cast<int64_t>(std::strtoll(value, nullptr, 10));
+        case ColumnKind::Float:
+            return floatToJson(std::strtod(value, nullptr), value, length);
+        case ColumnKind::Bool:
+            return value[0] == 't';
+        case ColumnKind::Json:
+            return parseEmbeddedJson(value, length);
+        case ColumnKind::Timestamp: {
+            // "2023-01-01 00:00:00" -> "2023-01-01T00:00:00"
+            std::string text(value, length);
+            size_t space = text.find(' ');
+            if (space != std::string::npos) {
+                text[space] = 'T';
+            }
+            return text;
+        }
+        case ColumnKind::Numeric:
+        case ColumnKind::Text:
+        default:
+            return std::string(value, length);
+    }
+}
+
+json ResultConverter::toJson(const PGresult* result) {
+    json jsonArray = json::array();
+
+    // Get number of rows and columns
+    int rows = PQntuples(result);
+    int cols = PQnfields(result);
+    auto& rowStorage = jsonArray.get_ref<json::array_t&>();
+    rowStorage.reserve(static_cast<size_t>(rows));
+
+    if (rows == 0) {
+        return jsonArray;
+    }
+
+    std::vector<ColumnInfo> columns = describe(result);
+
+    // Key order of the row objects, worked out once per result: columns
+    // sorted by name, duplicate names resolving to the last column as
+    // before. Each row then appends its members in that order behind an
+    // end hint, so every map node is built once with its final value and
+    // no key is searched for.
+    std::vector<int> order(static_cast<size_t>(cols));
+    for (int col = 0; col < cols; col++) {
+        order[col] = col;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return columns[a].name < columns[b].name;
+    });
+    auto last = std::unique(order.rbegin(), order.rend(), [&](int a, int b) {
+        return columns[a].name == columns[b].name;
+    });
+    order.erase(order.begin(), last.base());
+
+    // Iterate through rows
+    for (int row = 0; row < rows; row++) {
+        rowStorage.emplace_back(json::value_t::object);
+        auto& object = rowStorage.back().get_ref<json::object_t&>();
+
+        for (int col : order) {
+            if (PQgetisnull(result, row, col)) {
+                object.emplace_hint(object.end(), columns[col].name, nullptr);
+            } else {
+                object.emplace_hint(object.end(), columns[col].name,
+                                    cellToJson(result, row, col, columns[col]));
+            }
+        }
+    }
+
+    return jsonArray;
+}
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,325 @@
+#include "db/RowStream.h"
+#include <glog/logging.h>
+
+namespace securapp {
+namespace db {
+
+void StreamControl::pause() {
+    if (paused_ || cancelled_) {
+        return;
+    }
+    paused_ = true;
+    if (stream_) {
+        stream_->pauseReading();
+    }
+}
+
+void StreamControl::resume() {
+    if (!paused_) {
+        return;
+    }
+    paused_ = false;
+    if (stream_ && !cancelled_) {
+        stream_->resumeReading();
+    }
+}
+
+void StreamControl::cancel() {
+    if (cancelled_) {
+        return;
+    }
+    cancelled_ = true;
+    if (stream_) {
+        stream_->cancel();
+    }
+}
+
+folly::SemiFuture<folly::Unit> RowStream::start(
+    folly::EventBase* evb,
+    PooledConnection conn,
+    const std::string& query,
+    std::vector<std::string> params,
+    RowChunkCallback onChunk,
+    std::shared_ptr<StreamControl> control,
+    size_t chunkBytes) {
+
+    DCHECK(evb->isInEventBaseThread());
+
+    auto* stream = new RowStream(evb, std::move(conn), std::move(params),
+                                 std::move(onChunk), std::move(control), chunkBytes);
+    auto future = stream->promise_.getSemiFuture();
+
+    // On failure the promise is already completed and the object freed
+    if (stream->attach()) {
+        stream->sendQuery(query);
+    }
+    return future;
+}
+
+folly::SemiFuture<folly::Unit> RowStream::start(
+    folly::EventBase* evb,
+    PooledConnection conn,
+    std::shared_ptr<const PreparedStatement> statement,
+    std::vector<std::string> params,
+    RowChunkCallback onChunk,
+    std::shared_ptr<StreamControl> control,
+    size_t chunkBytes) {
+
+    DCHECK(evb->isInEventBaseThread());
+
+    auto* stream = new RowStream(evb, std::move(conn), std::move(params),
+                                 std::move(onChunk), std::move(control), chunkBytes);
+    auto future = stream->promise_.getSemiFuture();
+    stream->statement_ = std::move(statement);
+
+    if (stream->attach()) {
+        if (stream->conn_.connection()->isPrepared(stream->statement_->name)) {
+            stream->sendExecute();
+        } else {
+            stream->sendPrepare();
+        }
+    }
+    return future;
+}
+
+RowStream::RowStream(folly::EventBase* evb,
+                     PooledConnection conn,
+                     std::vector<std::string> params,
+                     RowChunkCallback onChunk,
+                     std::shared_ptr<StreamControl> control,
+                     size_t chunkBytes)
+    : AsyncOperation(evb, std::move(conn)),
+      onChunk_(std::move(onChunk)),
+      control_(std::move(control)),
+      chunkBytes_(chunkBytes),
+      writer_(chunkBytes),
+      params_(std::move(params)) {
+
+    // Convert string parameters to char* array once, reused on retries
+    paramValues_.reserve(params_.size());
+    for (const auto& param : params_) {
+        paramValues_.push_back(param.c_str());
+    }
+
+    writer_.writeRaw("[");
+}
+
+RowStream::~RowStream() {
+    if (control_->stream_ == this) {
+        control_->stream_ = nullptr;
+    }
+}
+
+bool RowStream::attach() {
+    if (control_->cancelled()) {
+        // The consumer left while we waited for a connection
+        cancel();
+        return false;
+    }
+    control_->stream_ = this;
+    return true;
+}
+
+bool RowStream::sendQuery(const std::string& query) {
+    PGconn* pg = conn_.get();
+    if (!enterNonBlocking()) {
+        return false;
+    }
+
+    int sent = PQsendQueryParams(
+        pg,
+        query.c_str(),
+        static_cast<int>(paramValues_.size()),
+        nullptr,  // param types
+        paramValues_.data(),
+        nullptr,  // param lengths
+        nullptr,  // param formats
+        0  // result format (0 = text)
+    );
+
+    if (!sent) {
+        onError(std::string("Failed to send query: ") + PQerrorMessage(pg));
+        return false;
+    }
+
+    phase_ = Phase::Executing;
+    return streamRows();
+}
+
+bool RowStream::sendPrepare() {
+    PGconn* pg = conn_.get();
+    if (!enterNonBlocking()) {
+        return false;
+    }
+
+    int sent = PQsendPrepare(
+        pg,
+        statement_->name.c_str(),
+        statement_->sql.c_str(),
+        static_cast<int>(statement_->paramTypes.size()),
+        statement_->paramTypes.empty() ? nullptr : statement_->paramTypes.data());
+
+    if (!sent) {
+        onError("Failed to prepare statement " + statement_->name + ": " + PQerrorMessage(pg));
+        return false;
+    }
+
+    phase_ = Phase::Preparing;
+    return flush();
+}
+
+bool RowStream::sendExecute() {
+    PGconn* pg = conn_.get();
+    if (!enterNonBlocking()) {
+        return false;
+    }
+
+    int sent = PQsendQueryPrepared(
+        pg,
+        statement_->name.c_str(),
+        static_cast<int>(paramValues_.size()),
+        paramValues_.data(),
+        nullptr,  // param lengths
+        nullptr,  // param formats
+        statement_->resultFormat()
+    );
+
+    if (!sent) {
+        onError("Failed to execute statement " + statement_->name + ": " + PQerrorMessage(pg));
+        return false;
+    }
+
+    phase_ = Phase::Executing;
+    return streamRows();
+}
+
+bool RowStream::streamRows() {
+    if (!PQsetSingleRowMode(conn_.get())) {
+        onError("Failed to switch query to single-row mode");
+        return false;
+    }
+    if (!flush()) {
+        return false;
+    }
+
+    // The consumer may have paused before the connection was ready
+    if (control_->paused()) {
+        pauseReading();
+    }
+    return true;
+}
+
+bool RowStream::onResult(ResultPtr result) {
+    if (!result) {
+        // All results for the command have arrived
+        return onCommandDone();
+    }
+
+    if (phase_ == Phase::Executing && PQresultStatus(result.get()) == PGRES_SINGLE_TUPLE) {
+        // Every row result has the same shape
+        if (!layout_) {
+            layout_ = JsonResultWriter::layout(result.get());
+        }
+        if (rows_++ > 0) {
+            writer_.writeRaw(",");
+        }
+        writer_.writeRow(result.get(), 0, *layout_);
+
+        if (writer_.size() >= chunkBytes_) {
+            return deliver();
+        }
+        return true;
+    }
+
+    // Keep the first error, otherwise the last result
+    if (!status_ || resultSucceeded(status_.get(), false)) {
+        status_ = std::move(result);
+    }
+    return true;
+}
+
+bool RowStream::onCommandDone() {
+    if (phase_ == Phase::Preparing) {
+        if (!resultSucceeded(status_.get(), false)) {
+            onError("Failed to prepare statement " + statement_->name + ": " +
+                    (status_ ? PQresultErrorMessage(status_.get()) : PQerrorMessage(conn_.get())));
+            return false;
+        }
+        conn_.connection()->markPrepared(statement_->name);
+        status_.reset();
+        return sendExecute();
+    }
+
+    // The session lost the statement behind our back: prepare it again once
+    // and retry. The server reports this before sending any row.
+    if (statement_ && !retried_ && rows_ == 0 &&
+        hasSqlState(status_.get(), kSqlStateUndefinedStatement)) {
+        retried_ = true;
+        conn_.connection()->forgetPrepared(statement_->name);
+        status_.reset();
+        return sendPrepare();
+    }
+
+    finish();
+    return false;
+}
+
+bool RowStream::deliver() {
+    auto chunk = writer_.finish();
+    if (!chunk) {
+        return true;
+    }
+
+    delivering_ = true;
+    onChunk_(std::move(chunk));
+    delivering_ = false;
+
+    if (control_->cancelled()) {
+        cancel();
+        return false;
+    }
+    return true;
+}
+
+void RowStream::cancel() {
+    if (delivering_) {
+        // Handled once the chunk callback returns
+        return;
+    }
+
+    // A query still in progress leaves the session busy; the pool drops
+    // such connections instead of reusing them
+    releaseConnection();
+    promise_.setException(DatabaseError("Row stream cancelled"));
+    delete this;
+}
+
+void RowStream::finish() {
+    if (!resultSucceeded(status_.get(), true)) {
+        onError(std::string("Query execution failed: ") +
+                (status_ ? PQresultErrorMessage(status_.get()) : PQerrorMessage(conn_.get())));
+        return;
+    }
+
+    // The connection is done with; return it before the consumer's work
+    releaseConnection();
+
+    writer_.writeRaw("]");
+    if (!deliver()) {
+        return;
+    }
+
+    promise_.setValue();
+    delete this;
+}
+
+void RowStream::onError(const std::string& message) {
+    LOG(ERROR) << message;
+
+    releaseConnection();
+    promise_.setException(DatabaseError(message));
+    delete this;
+}
+
+} // namespace db
+} // namespace securapp
@@ -0,0 +1,105 @@
+#include "db/TokenStore.h"
+#include <glog/logging.h>
+#include <cstdlib>
+
+namespace securapp {
+namespace db {
+
+TokenStore& TokenStore::getInstance() {
+    static TokenStore instance;
+    return instance;
+}
+
+void TokenStore::configure(const util::TokenCacheOptions& options) {
+    cache_ = std::make_unique<util::TokenCache>(options);
+    LOG(INFO) << "Token cache holds up to " << options.maxEntries << " tokens, valid ones for "
+              << options.ttl.count() << "ms, invalid ones for " << options.negativeTtl.count() << "ms";
+}
+
+void TokenStore::registerStatements() {
+    auto& db = DatabaseManager::getInstance();
+
+    // Live token lookup. expires_at has no time zone, so the remaining
+    // lifetime is computed by the server against its own clock.
+    db.registerStatement("user_tokens_lookup",
+        "SELECT user_id, EXTRACT(EPOCH FROM expires_at - LOCALTIMESTAMP)::float8 "
+        "FROM user_tokens WHERE token = $1 AND NOT is_revoked AND expires_at > LOCALTIMESTAMP",
+        {pgtype::kVarchar});
+
+    db.registerStatement("user_tokens_insert",
+        "INSERT INTO user_tokens (user_id, token, expires_at) "
+        "VALUES ($1, $2, LOCALTIMESTAMP + make_interval(secs => $3))",
+        {pgtype::kInt4, pgtype::kVarchar, pgtype::kFloat8});
+
+    db.registerStatement("user_tokens_revoke",
+        "UPDATE user_tokens SET is_revoked = TRUE WHERE token = $1 AND NOT is_revoked",
+        {pgtype::kVarchar});
+}
+
+std::optional<util::TokenInfo> TokenStore::cached(std::string_view token) {
+    if (!cache_) {
+        return std::nullopt;
+    }
+    return cache_->lookup(token);
+}
+
+folly::SemiFuture<util::TokenInfo> TokenStore::validate(std::string token, folly::EventBase* evb,
+                                                        std::shared_ptr<QueryTiming> timing) {
+    auto result = DatabaseManager::getInstance().preparedAsync(
+        "user_tokens_lookup", {token}, true, evb, std::move(timing));
+    return std::move(result).deferValue([this, token = std::move(token)](ResultPtr rows) {
+        util::TokenInfo info;
+        if (PQntuples(rows.get()) == 0) {
+            if (cache_) {
+                cache_->storeInvalid(token);
+            }
+            return info;
+        }
+
+        info.valid = true;
+        info.userId = std::strtoll(PQgetvalue(rows.get(), 0, 0), nullptr, 10);
+        double remaining = std::strtod(PQgetvalue(rows.get(), 0, 1), nullptr);
+        info.expiresAt = std::chrono::system_clock::now() +
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::duration<double>(remaining));
+        if (cache_) {
+            cache_->storeValid(token, info.userId, info.expiresAt);
+        }
+        return info;
+    });
+}
+
+folly::SemiFuture<folly::Unit> TokenStore::issue(std::string token, int64_t userId,
+                                                 std::chrono::seconds lifetime, folly::EventBase* evb,
+                                                 std::shared_ptr<QueryTiming> timing) {
+    auto expiresAt = std::chrono::system_clock::now() + lifetime;
+    std::vector<std::string> params = {
+        std::to_string(userId), token, std::to_string(lifetime.count())
+    };
+    return DatabaseManager::getInstance()
+        .executePreparedAsync("user_tokens_insert", std::move(params), evb, std::move(timing))
+        .deferValue([this, token = std::move(token), userId, expiresAt](folly::Unit) {
+            if (cache_) {
+                cache_->storeValid(token, userId, expiresAt);
+            }
+        });
+}
+
+folly::SemiFuture<bool> TokenStore::revoke(std::string token,
+                                           std::chrono::system_clock::time_point expiresAt,
+                                           folly::EventBase* evb,
+                                           std::shared_ptr<QueryTiming> timing) {
+    // Refuse the token from now on, before the database has it
+    if (cache_) {
+        cache_->storeRevoked(token, expiresAt);
+    }
+
+    return DatabaseManager::getInstance()
+        .preparedAsync("user_tokens_revoke", {std::move(token)}, false, evb, std::move(timing))
+        .deferValue([](ResultPtr result) {
+            return std::strtol(PQcmdTuples(result.get()), nullptr, 10) > 0;
+        });
+}
+
+} // namespace db
+} // namespace securapp
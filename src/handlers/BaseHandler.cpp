@@ -1,45 +1,235 @@
 #include "handlers/BaseHandler.h"
+#include "db/DatabaseManager.h"
+#include "util/AccessLog.h"
+#include "util/SlowRequestLog.h"
 #include <glog/logging.h>
 #include <folly/io/IOBuf.h>
 #include <folly/Conv.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 namespace securapp {
 namespace handlers {
 
+BodyOptions BodyOptions::fromConfig(const json& serverConfig) {
+    BodyOptions options;
+    options.maxSize = serverConfig.value("max_body_size", options.maxSize);
+
+    std::string parser = serverConfig.value("json_parser", "nlohmann");
+    if (parser == "incremental") {
+        options.jsonParser = JsonParser::Incremental;
+    } else if (parser == "simdjson") {
+#ifdef SECURAPP_HAVE_SIMDJSON
+        options.jsonParser = JsonParser::Simd;
+#else
+        LOG(WARNING) << "Built without simdjson, using the nlohmann JSON parser";
+#endif
+    }
+    return options;
+}
+
+ResponseOptions ResponseOptions::fromConfig(const json& serverConfig) {
+    ResponseOptions options;
+    options.prettyJson = serverConfig.value("pretty_json", options.prettyJson);
+    options.serverTiming = serverConfig.value("server_timing", options.serverTiming);
+    return options;
+}
+
 BaseHandler::BaseHandler() = default;
 
+BaseHandler::~BaseHandler() {
+    // Stop a stream still feeding this response
+    if (stream_) {
+        stream_->cancel();
+    }
+
+    // Arena-backed values go while their arena is still current
+    util::Arena::Scope scope(arena_);
+    jsonParser_.reset();
+    jsonBody_ = util::ArenaJson();
+}
+
+void BaseHandler::setRequestStart(std::chrono::steady_clock::time_point arrived) {
+    requestStart_ = arrived;
+    timing_.addSince(util::Phase::Route, arrived);
+}
+
 void BaseHandler::onRequest(std::unique_ptr<proxygen::HTTPMessage> headers) noexcept {
+    CallbackScope scope(*this);
+    bodyStart_ = std::chrono::steady_clock::now();
+    if (requestStart_ == std::chrono::steady_clock::time_point()) {
+        requestStart_ = bodyStart_;
+    }
     headers_ = std::move(headers);
+    evb_ = folly::EventBaseManager::get()->getExistingEventBase();
+
+    encoding_ = util::encodingForAccept(
+        headers_->getHeaders().getSingleOrEmpty(proxygen::HTTP_HEADER_ACCEPT));
+    if (encoding_ == util::Encoding::Json &&
+        (responseOptions_.prettyJson || headers_->getQueryParam("pretty") == "1")) {
+        encoding_ = util::Encoding::PrettyJson;
+    }
+
+    if (retryAfter_.count() > 0) {
+        rejected_ = true;
+        sendTooManyRequests();
+        return;
+    }
+
+    // Refuse a declared oversized body before any of it is read
+    const std::string& contentLength =
+        headers_->getHeaders().getSingleOrEmpty(proxygen::HTTP_HEADER_CONTENT_LENGTH);
+    if (!contentLength.empty() &&
+        std::strtoull(contentLength.c_str(), nullptr, 10) > bodyOptions_.maxSize) {
+        rejectBody(413, "Request body too large");
+        return;
+    }
+
+    if (bodyOptions_.jsonParser == BodyOptions::JsonParser::Incremental && isJsonRequest()) {
+        jsonParser_ = std::make_unique<util::JsonStreamParser>(requestFields());
+    }
 }
 
 void BaseHandler::onBody(std::unique_ptr<folly::IOBuf> body) noexcept {
-    if (body) {
-        std::string bodyPart = body->moveToFbString().toStdString();
-        body_.append(bodyPart);
+    if (!body || rejected_) {
+        return;
+    }
+    CallbackScope scope(*this);
+
+    // Chunked uploads carry no Content-Length, so check as the body grows
+    bodyLength_ += body->computeChainDataLength();
+    if (bodyLength_ > bodyOptions_.maxSize) {
+        rejectBody(413, "Request body too large");
+        return;
+    }
+
+    if (jsonParser_) {
+        // Parse in place; the chunk is not kept
+        auto parseStart = std::chrono::steady_clock::now();
+        for (const folly::ByteRange range : *body) {
+            if (!jsonParser_->feed(reinterpret_cast<const char*>(range.data()), range.size())) {
+                LOG(ERROR) << "JSON parsing error: " << jsonParser_->error();
+                rejectBody(400, "Invalid JSON in request body");
+                return;
+            }
+        }
+        timing_.addSince(util::Phase::Parse, parseStart);
+        return;
     }
+
+    // Keep the buffers proxygen handed us; nothing is copied here
+    body_.append(std::move(body));
 }
 
 void BaseHandler::onEOM() noexcept {
-    try {
+    if (rejected_) {
+        return;
+    }
+    CallbackScope scope(*this);
+
+    // Incremental parsing happened while the body arrived; count it once
+    auto now = std::chrono::steady_clock::now();
+    timing_.add(util::Phase::Body, now - bodyStart_ - timing_.spent(util::Phase::Parse));
+
+    if (jsonParser_ && bodyLength_ > 0) {
+        bool finished = jsonParser_->finish();
+        timing_.addSince(util::Phase::Parse, now);
+        if (!finished) {
+            LOG(ERROR) << "JSON parsing error: " << jsonParser_->error();
+            sendErrorResponse(400, "Invalid JSON in request body");
+            return;
+        }
+        jsonBody_ = jsonParser_->release();
+        hasJsonBody_ = true;
+        bodyView_ = util::JsonView(&jsonBody_);
+        jsonParser_.reset();
+    } else if (!body_.empty() && isJsonRequest()) {
         // If there's a body and Content-Type is application/json, parse it
-        if (!body_.empty() &&
-            headers_->getHeaders().getSingleOrEmpty("Content-Type").find("application/json") != std::string::npos) {
+        bool parsed = parseBody();
+        timing_.addSince(util::Phase::Parse, now);
+        if (!parsed) {
+            return;
+        }
+    }
 
-            jsonBody_ = json::parse(body_);
-            hasJsonBody_ = true;
+    // Process the request
+    handleRequest();
+}
+
+bool BaseHandler::parseBody() {
+#ifdef SECURAPP_HAVE_SIMDJSON
+    if (bodyOptions_.jsonParser == BodyOptions::JsonParser::Simd) {
+        folly::ByteRange bytes = bodyBytes(simdjson::SIMDJSON_PADDING);
+        std::string error;
+        if (!util::parseSimdJson(bytes.data(), bytes.size(), bodyView_, error)) {
+            LOG(ERROR) << "JSON parsing error: " << error;
+            sendErrorResponse(400, "Invalid JSON in request body");
+            return false;
         }
+        hasJsonBody_ = true;
+        return true;
+    }
+#endif
+
+    try {
+        folly::ByteRange bytes = bodyBytes();
+        jsonBody_ = util::ArenaJson::parse(bytes.begin(), bytes.end());
+        hasJsonBody_ = true;
+        bodyView_ = util::JsonView(&jsonBody_);
+        return true;
     } catch (const json::exception& e) {
         LOG(ERROR) << "JSON parsing error: " << e.what();
         sendErrorResponse(400, "Invalid JSON in request body");
-        return;
     } catch (const std::exception& e) {
         LOG(ERROR) << "Error processing request body: " << e.what();
         sendErrorResponse(500, "Internal server error");
-        return;
     }
+    return false;
+}
 
-    // Process the request
-    handleRequest();
+folly::ByteRange BaseHandler::bodyBytes(size_t tailroom) {
+    if (body_.empty()) {
+        return folly::ByteRange();
+    }
+
+    auto buf = body_.move();
+    if (buf->isChained() || buf->tailroom() < tailroom) {
+        buf->coalesceWithHeadroomTailroom(0, tailroom);
+    }
+    folly::ByteRange bytes(buf->data(), buf->length());
+    body_.append(std::move(buf));
+    return bytes;
+}
+
+bool BaseHandler::isJsonRequest() const {
+    return headers_->getHeaders().getSingleOrEmpty("Content-Type").find("application/json") != std::string::npos;
+}
+
+void BaseHandler::rejectBody(uint16_t statusCode, const std::string& message) {
+    rejected_ = true;
+    body_.reset();
+    jsonParser_.reset();
+    sendErrorResponse(statusCode, message);
+}
+
+void BaseHandler::sendTooManyRequests() {
+    util::ArenaJson errorJson = {
+        {"status", "error"},
+        {"message", "Too many requests"}
+    };
+
+    auto body = encodeBody(errorJson, 64);
+    responseBytes_ += body->computeChainDataLength();
+    proxygen::ResponseBuilder response(downstream_);
+    beginResponse(response, 429, "Too Many Requests");
+    response
+        .header("Retry-After", folly::to<std::string>(retryAfter_.count()))
+        .header("Content-Type", util::contentType(encoding_))
+        .header("Vary", "Accept")
+        .body(std::move(body))
+        .sendWithEOM();
 }
 
 void BaseHandler::onUpgrade(proxygen::UpgradeProtocol proto) noexcept {
@@ -48,36 +238,255 @@ void BaseHandler::onUpgrade(proxygen::UpgradeProtocol proto) noexcept {
 }
 
 void BaseHandler::requestComplete() noexcept {
-    // Request is complete, delete this handler
-    delete this;
+    // Request is complete, recycle this handler
+    done();
 }
 
 void BaseHandler::onError(proxygen::ProxygenError err) noexcept {
     LOG(ERROR) << "Request handler error: " << proxygen::getErrorString(err);
-    // Request is complete with error, delete this handler
-    delete this;
+    // Request is complete with error, recycle this handler
+    done();
+}
+
+void BaseHandler::done() {
+    recordRequest();
+    if (recycler_) {
+        recycler_(this);
+    } else {
+        delete this;
+    }
+}
+
+void BaseHandler::recordRequest() {
+    if (!headers_) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (responseStart_ != std::chrono::steady_clock::time_point()) {
+        timing_.add(util::Phase::Send, now - responseStart_);
+    }
+
+    uint64_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - requestStart_).count();
+    if (routeMetrics_) {
+        routeMetrics_->record(responseStatus_, latencyUs);
+    }
+    if (util::SlowRequestLog::getInstance().isSlow(latencyUs)) {
+        recordSlowRequest(latencyUs);
+    }
+
+    auto& log = util::AccessLog::getInstance();
+    if (!log.sampled(responseStatus_)) {
+        return;
+    }
+
+    util::AccessRecord record;
+    record.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    record.latencyUs = static_cast<uint32_t>(latencyUs);
+    record.status = responseStatus_;
+    record.bytesOut = responseBytes_;
+
+    const std::string& method = headers_->getMethodString();
+    std::memcpy(record.method, method.data(), std::min(method.size(), sizeof(record.method) - 1));
+    const std::string& path = headers_->getPath();
+    std::memcpy(record.path, path.data(), std::min(path.size(), sizeof(record.path) - 1));
+
+    log.record(record);
+}
+
+void BaseHandler::recordSlowRequest(uint64_t latencyUs) {
+    util::SlowRequest request;
+    request.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    request.latencyUs = latencyUs;
+    request.status = responseStatus_;
+    for (size_t i = 0; i < util::kPhaseCount; i++) {
+        request.phaseUs[i] = timing_.micros(static_cast<util::Phase>(i));
+    }
+
+    const std::string& method = headers_->getMethodString();
+    std::memcpy(request.method, method.data(), std::min(method.size(), sizeof(request.method) - 1));
+    const std::string& path = headers_->getPath();
+    std::memcpy(request.path, path.data(), std::min(path.size(), sizeof(request.path) - 1));
+
+    util::SlowRequestLog::getInstance().record(request);
+}
+
+std::shared_ptr<db::QueryTiming> BaseHandler::queryTiming() {
+    // A call of an earlier request may still be writing to the old one
+    if (!query_ || query_.use_count() > 1) {
+        query_ = std::make_shared<db::QueryTiming>();
+    } else {
+        *query_ = db::QueryTiming();
+    }
+    queryPending_ = true;
+    return query_;
+}
+
+void BaseHandler::collectQueryTiming() {
+    if (!queryPending_) {
+        return;
+    }
+    queryPending_ = false;
+
+    // A call that failed early leaves the later points unset
+    const db::QueryTiming& query = *query_;
+    const std::chrono::steady_clock::time_point unset;
+    if (query.queued != unset && query.acquired != unset) {
+        timing_.add(util::Phase::DbWait, query.acquired - query.queued);
+        if (query.finished != unset) {
+            timing_.add(util::Phase::Db, query.finished - query.acquired);
+        }
+    }
+}
+
+void BaseHandler::reset() {
+    // Stop a stream still feeding the finished response
+    if (stream_) {
+        stream_->cancel();
+        stream_.reset();
+    }
+    streamStarted_ = false;
+
+    // Continuations of the finished request must not run on the next one
+    alive_ = std::make_shared<bool>(true);
+
+    evb_ = nullptr;
+    headers_.reset();
+    routeParams_ = RouteParams();
+    body_.reset();
+    bodyLength_ = 0;
+    encoding_ = util::Encoding::Json;
+    hasJsonBody_ = false;
+    bodyView_ = util::JsonView();
+    rejected_ = false;
+    retryAfter_ = std::chrono::seconds(0);
+    routeMetrics_ = nullptr;
+    responseStatus_ = 0;
+    responseBytes_ = 0;
+    requestStart_ = std::chrono::steady_clock::time_point();
+    bodyStart_ = std::chrono::steady_clock::time_point();
+    responseStart_ = std::chrono::steady_clock::time_point();
+    timing_.clear();
+    queryPending_ = false;
+
+    // Destroy arena-backed values, then release the arena in one go
+    {
+        util::Arena::Scope scope(arena_);
+        jsonParser_.reset();
+        jsonBody_ = util::ArenaJson();
+    }
+    arena_.reset();
+}
+
+void BaseHandler::onEgressPaused() noexcept {
+    // The client is not keeping up; stop reading rows from the database
+    if (stream_) {
+        stream_->pause();
+    }
+}
+
+void BaseHandler::onEgressResumed() noexcept {
+    if (stream_) {
+        stream_->resume();
+    }
 }
 
 void BaseHandler::sendErrorResponse(uint16_t statusCode, const std::string& errorMessage) {
-    json errorJson = {
+    util::ArenaJson errorJson = {
         {"status", "error"},
         {"message", errorMessage}
     };
 
-    proxygen::ResponseBuilder(downstream_)
-        .status(statusCode, errorMessage)
-        .header("Content-Type", "application/json")
-        .body(errorJson.dump(2))  // indent with 2 spaces
-        .sendWithEOM();
+    sendEncoded(statusCode, errorMessage, encodeBody(errorJson, 128));
 }
 
 void BaseHandler::sendJsonResponse(uint16_t statusCode, const json& jsonBody) {
-    proxygen::ResponseBuilder(downstream_)
-        .status(statusCode, "OK")
-        .header("Content-Type", "application/json")
-        .body(jsonBody.dump(2))  // indent with 2 spaces
+    sendEncoded(statusCode, "OK", encodeBody(jsonBody));
+}
+
+void BaseHandler::sendJsonResponse(uint16_t statusCode, const util::ArenaJson& jsonBody) {
+    sendEncoded(statusCode, "OK", encodeBody(jsonBody));
+}
+
+void BaseHandler::beginResponse(proxygen::ResponseBuilder& response, uint16_t statusCode,
+                                const std::string& reason) {
+    responseStatus_ = statusCode;
+    responseStart_ = std::chrono::steady_clock::now();
+    response.status(statusCode, reason);
+    if (responseOptions_.serverTiming) {
+        response.header("Server-Timing", timing_.serverTiming(responseStart_ - requestStart_));
+    }
+}
+
+void BaseHandler::sendEncoded(uint16_t statusCode, const std::string& reason,
+                              std::unique_ptr<folly::IOBuf> body) {
+    responseBytes_ += body->computeChainDataLength();
+    proxygen::ResponseBuilder response(downstream_);
+    beginResponse(response, statusCode, reason);
+    response
+        .header("Content-Type", util::contentType(encoding_))
+        .header("Vary", "Accept")
+        .body(std::move(body))
+        .sendWithEOM();
+}
+
+void BaseHandler::sendRawJsonResponse(uint16_t statusCode, std::unique_ptr<folly::IOBuf> body) {
+    sendRawResponse(statusCode, "application/json", std::move(body));
+}
+
+void BaseHandler::sendRawResponse(uint16_t statusCode, const std::string& contentType,
+                                  std::unique_ptr<folly::IOBuf> body) {
+    responseBytes_ += body->computeChainDataLength();
+    proxygen::ResponseBuilder response(downstream_);
+    beginResponse(response, statusCode, "OK");
+    response
+        .header("Content-Type", contentType)
+        .body(std::move(body))
         .sendWithEOM();
 }
 
+void BaseHandler::streamPrepared(const std::string& name, std::vector<std::string> params) {
+    stream_ = std::make_shared<db::StreamControl>();
+
+    // Headers go out with the first chunk, so a query that fails before
+    // producing rows still gets a proper error response
+    auto onChunk = [this](std::unique_ptr<folly::IOBuf> chunk) {
+        responseBytes_ += chunk->computeChainDataLength();
+        if (!streamStarted_) {
+            streamStarted_ = true;
+            proxygen::ResponseBuilder response(downstream_);
+            beginResponse(response, 200, "OK");
+            response
+                .header("Content-Type", "application/json")
+                .body(std::move(chunk))
+                .send();
+        } else {
+            proxygen::ResponseBuilder(downstream_)
+                .body(std::move(chunk))
+                .send();
+        }
+    };
+
+    auto done = db::DatabaseManager::getInstance().streamPreparedAsync(
+        name, std::move(params), std::move(onChunk), stream_, evb_, queryTiming());
+
+    whenReady(std::move(done), [this](folly::Try<folly::Unit>&& result) {
+        stream_.reset();
+        if (!result.hasException()) {
+            proxygen::ResponseBuilder(downstream_).sendWithEOM();
+        } else if (streamStarted_) {
+            // Part of the body is already out; the client must see a failure
+            LOG(ERROR) << "Row stream failed mid-response: " << result.exception().what();
+            downstream_->sendAbort();
+        } else {
+            LOG(ERROR) << "Row stream failed: " << result.exception().what();
+            sendErrorResponse(500, "Database error");
+        }
+    });
+}
+
 } // namespace handlers
 } // namespace securapp
@@ -2,47 +2,113 @@
 #include "handlers/HealthCheckHandler.h"
 #include "handlers/NotFoundHandler.h"
 #include "handlers/ApiHandler.h"
+#include "handlers/MethodNotAllowedHandler.h"
+#include "handlers/MetricsHandler.h"
+#include "handlers/HandlerPool.h"
+#include "handlers/SlowRequestsHandler.h"
+#include "util/LoopMonitor.h"
+#include "util/LoopObserver.h"
 #include <glog/logging.h>
-#include <folly/Uri.h>
 
 namespace securapp {
 namespace handlers {
 
-HandlerFactory::HandlerFactory(const json& config) : config_(config) {
+namespace {
+
+template <typename T>
+BaseHandler* pooled(const std::shared_ptr<const json>& /* config */) {
+    return HandlerPool<T>::acquire();
+}
+
+template <ApiHandler::Endpoint E>
+BaseHandler* apiEndpoint(const std::shared_ptr<const json>& config) {
+    ApiHandler* handler = HandlerPool<ApiHandler>::acquire(config);
+    handler->setEndpoint(E);
+    return handler;
+}
+
+} // namespace
+
+HandlerFactory::HandlerFactory(const json& config)
+    : config_(std::make_shared<const json>(config)),
+      unmatchedMetrics_("*", "unmatched") {
+    bodyOptions_ = BodyOptions::fromConfig(config_->value("server", json::object()));
+    responseOptions_ = ResponseOptions::fromConfig(config_->value("server", json::object()));
+    buildRoutes();
     LOG(INFO) << "Handler factory initialized";
 }
 
+void HandlerFactory::buildRoutes() {
+    addRoute(RouteMethod::Any, "/health", &pooled<HealthCheckHandler>);
+    addRoute(RouteMethod::Get, "/metrics", &pooled<MetricsHandler>);
+    if (config_->value("server", json::object()).value("debug_endpoints", false)) {
+        addRoute(RouteMethod::Get, "/debug/slow-requests", &pooled<SlowRequestsHandler>);
+    }
+
+    addRoute(RouteMethod::Post, "/api/auth", &apiEndpoint<ApiHandler::Endpoint::Auth>);
+    addRoute(RouteMethod::Delete, "/api/auth", &apiEndpoint<ApiHandler::Endpoint::Logout>);
+    addRoute(RouteMethod::Get, "/api/users", &apiEndpoint<ApiHandler::Endpoint::ListUsers>);
+    addRoute(RouteMethod::Post, "/api/users", &apiEndpoint<ApiHandler::Endpoint::CreateUser>);
+    addRoute(RouteMethod::Get, "/api/users/export", &apiEndpoint<ApiHandler::Endpoint::ExportUsers>);
+    addRoute(RouteMethod::Get, "/api/users/{id}", &apiEndpoint<ApiHandler::Endpoint::GetUser>);
+}
+
+void HandlerFactory::addRoute(RouteMethod method, const std::string& pattern, HandlerCreator create) {
+    // Metrics are labelled with the pattern, so ids do not create series
+    router_.add(method, pattern, Route{create, util::RouteMetrics(routeMethodName(method), pattern)});
+}
+
 void HandlerFactory::onServerStart(folly::EventBase* evb) noexcept {
     LOG(INFO) << "Server started";
     evb_ = evb;
+
+    // Called on each IO thread with its own EventBase
+    evb->setObserver(std::make_shared<util::LoopObserver>());
+    util::LoopMonitor::getInstance().attach(evb);
 }
 
 void HandlerFactory::onServerStop() noexcept {
     LOG(INFO) << "Server stopped";
+    util::LoopMonitor::getInstance().detach();
 }
 
 proxygen::RequestHandler* HandlerFactory::onRequest(
     proxygen::RequestHandler* /* handler */,
     proxygen::HTTPMessage* message) noexcept {
+    auto arrived = std::chrono::steady_clock::now();
 
     try {
-        // Get the path from the request
-        folly::Uri uri(message->getURL());
-        std::string path = uri.path();
+        // The path as parsed by proxygen, without the query string
+        const std::string& path = message->getPath();
 
-        LOG(INFO) << "Request received: " << message->getMethodString() << " " << path;
+        VLOG(1) << "Request received: " << message->getMethodString() << " " << path;
 
         // Route the request to the appropriate handler
-        if (path == "/health" || path == "/health/") {
-            return new HealthCheckHandler();
-        } else if (path.find("/api/") == 0) {
-            return new ApiHandler(config_);
-        } else {
-            return new NotFoundHandler();
+        auto match = router_.match(message->getMethodString(), path);
+
+        BaseHandler* handler;
+        const util::RouteMetrics* metrics = &unmatchedMetrics_;
+        switch (match.status) {
+            case Router<Route>::Status::Found:
+                handler = match.value->create(config_);
+                metrics = &match.value->metrics;
+                break;
+            case Router<Route>::Status::MethodNotAllowed:
+                handler = HandlerPool<MethodNotAllowedHandler>::acquire();
+                break;
+            default:
+                handler = HandlerPool<NotFoundHandler>::acquire();
+                break;
         }
+        handler->setBodyOptions(bodyOptions_);
+        handler->setResponseOptions(responseOptions_);
+        handler->setRouteParams(match.params);
+        handler->setRouteMetrics(metrics);
+        handler->setRequestStart(arrived);
+        return handler;
     } catch (const std::exception& e) {
         LOG(ERROR) << "Error routing request: " << e.what();
-        return new NotFoundHandler();
+        return HandlerPool<NotFoundHandler>::acquire();
     }
 }
 
@@ -5,16 +5,41 @@
 namespace securapp {
 namespace handlers {
 
+void HealthCheckHandler::registerStatements() {
+    db::DatabaseManager::getInstance().registerStatement("health_ping", "SELECT 1");
+}
+
 void HealthCheckHandler::handleRequest() {
-    // Check database connectivity
-    bool dbConnected = db::DatabaseManager::getInstance().isConnected();
+    auto& db = db::DatabaseManager::getInstance();
+    if (!db.isConnected()) {
+        sendHealth(false);
+        return;
+    }
+
+    // Round trip to the database without blocking the event loop
+    whenReady(db.executePreparedAsync("health_ping", {}, evb_, queryTiming()),
+        [this](folly::Try<folly::Unit>&& result) {
+            sendHealth(result.hasValue());
+        });
+}
+
+void HealthCheckHandler::sendHealth(bool dbConnected) {
+    db::PoolStats pool = db::DatabaseManager::getInstance().getPoolStats();
 
     json healthJson = {
         {"status", "ok"},
         {"timestamp", std::time(nullptr)},
         {"components", {
             {"database", {
-                {"status", dbConnected ? "up" : "down"}
+                {"status", dbConnected ? "up" : "down"},
+                {"pool", {
+                    {"connections", pool.total},
+                    {"idle", pool.idle},
+                    {"checkouts", pool.checkouts},
+                    {"checkout_timeouts", pool.checkoutTimeouts},
+                    {"checkout_wait_max_us", pool.checkoutWaitMaxUs},
+                    {"reconnects", pool.reconnects}
+                }}
             }},
             {"server", {
                 {"status", "up"}
@@ -23,7 +48,7 @@ void HealthCheckHandler::handleRequest() {
     };
 
     sendJsonResponse(200, healthJson);
-    LOG(INFO) << "Health check completed: " << (dbConnected ? "all systems up" : "database is down");
+    VLOG(1) << "Health check completed: " << (dbConnected ? "all systems up" : "database is down");
 }
 
 } // namespace handlers
@@ -0,0 +1,14 @@
+#include "handlers/MethodNotAllowedHandler.h"
+#include <glog/logging.h>
+
+namespace securapp {
+namespace handlers {
+
+void MethodNotAllowedHandler::handleRequest() {
+    VLOG(1) << "Method not allowed: " << headers_->getMethodString() << " " << headers_->getPath();
+
+    sendErrorResponse(405, "Method not allowed");
+}
+
+} // namespace handlers
+} // namespace securapp
@@ -0,0 +1,41 @@
+#include "handlers/MetricsHandler.h"
+#include "db/DatabaseManager.h"
+#include "util/AccessLog.h"
+#include "util/Metrics.h"
+#include <folly/io/IOBuf.h>
+
+namespace securapp {
+namespace handlers {
+
+void MetricsHandler::handleRequest() {
+    std::string out;
+    out.reserve(64 * 1024);
+
+    auto& metrics = util::Metrics::getInstance();
+    metrics.render(out);
+    metrics.renderQuantiles(out, "event_loop_lag_seconds", "event_loop_lag_quantile_seconds",
+        "Event loop lag percentiles since startup", {0.5, 0.9, 0.99, 0.999, 1.0});
+
+    db::PoolStats pool = db::DatabaseManager::getInstance().getPoolStats();
+    util::Metrics::writeValue(out, "db_pool_connections", "gauge",
+        "Open database connections", pool.total);
+    util::Metrics::writeValue(out, "db_pool_idle_connections", "gauge",
+        "Database connections waiting in the pool", pool.idle);
+    util::Metrics::writeValue(out, "db_pool_checkouts_total", "counter",
+        "Connections handed out by the pool", pool.checkouts);
+    util::Metrics::writeValue(out, "db_pool_checkout_timeouts_total", "counter",
+        "Checkouts that gave up waiting for a connection", pool.checkoutTimeouts);
+    util::Metrics::writeValue(out, "db_pool_reconnects_total", "counter",
+        "Broken connections reopened by the pool", pool.reconnects);
+
+    auto& accessLog = util::AccessLog::getInstance();
+    util::Metrics::writeValue(out, "access_log_records_total", "counter",
+        "Access log records written", accessLog.written());
+    util::Metrics::writeValue(out, "access_log_dropped_total", "counter",
+        "Access log records dropped because a buffer was full", accessLog.dropped());
+
+    sendRawResponse(200, "text/plain; version=0.0.4", folly::IOBuf::copyBuffer(out));
+}
+
+} // namespace handlers
+} // namespace securapp
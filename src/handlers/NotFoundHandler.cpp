@@ -5,7 +5,7 @@ namespace securapp {
 namespace handlers {
 
 void NotFoundHandler::handleRequest() {
-    LOG(INFO) << "Resource not found: " << headers_->getPath();
+    VLOG(1) << "Resource not found: " << headers_->getPath();
 
     sendErrorResponse(404, "Resource not found");
 }
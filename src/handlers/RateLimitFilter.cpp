@@ -0,0 +1,53 @@
+#include "handlers/RateLimitFilter.h"
+#include "handlers/BaseHandler.h"
+#include <glog/logging.h>
+
+namespace securapp {
+namespace handlers {
+
+RateLimitFilterFactory::RateLimitFilterFactory(const json& securityConfig) {
+    auto options = util::RateLimitOptions::fromConfig(
+        securityConfig.value("rate_limit", json::object()));
+    if (!options.enabled) {
+        LOG(INFO) << "Rate limiting disabled";
+        return;
+    }
+
+    limiter_ = std::make_unique<util::RateLimiter>(options);
+    limitedCounter_ = util::Metrics::getInstance().counter("rate_limited_requests_total", "",
+        "Requests answered with 429 by the rate limiter");
+    LOG(INFO) << "Rate limiting clients to " << options.requestsPerMinute << " requests per minute";
+}
+
+void RateLimitFilterFactory::onServerStart(folly::EventBase* /* evb */) noexcept {}
+
+void RateLimitFilterFactory::onServerStop() noexcept {}
+
+proxygen::RequestHandler* RateLimitFilterFactory::onRequest(
+    proxygen::RequestHandler* handler,
+    proxygen::HTTPMessage* message) noexcept {
+
+    if (!limiter_) {
+        return handler;
+    }
+
+    std::chrono::seconds retryAfter;
+    if (limiter_->allow(message->getClientIP(), retryAfter)) {
+        return handler;
+    }
+
+    VLOG(1) << "Rate limited " << message->getClientIP() << ": "
+            << message->getMethodString() << " " << message->getPath();
+    util::Metrics::getInstance().add(limitedCounter_);
+
+    // HandlerFactory, next in the chain, only creates BaseHandlers
+    auto* routed = dynamic_cast<BaseHandler*>(handler);
+    DCHECK(routed) << "Rate limiter must wrap HandlerFactory";
+    if (routed) {
+        routed->setRateLimited(retryAfter);
+    }
+    return handler;
+}
+
+} // namespace handlers
+} // namespace securapp
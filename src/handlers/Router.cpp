@@ -0,0 +1,39 @@
+#include "handlers/Router.h"
+
+namespace securapp {
+namespace handlers {
+
+std::optional<RouteMethod> parseRouteMethod(std::string_view method) {
+    if (method == "GET") {
+        return RouteMethod::Get;
+    } else if (method == "POST") {
+        return RouteMethod::Post;
+    } else if (method == "PUT") {
+        return RouteMethod::Put;
+    } else if (method == "PATCH") {
+        return RouteMethod::Patch;
+    } else if (method == "DELETE") {
+        return RouteMethod::Delete;
+    } else if (method == "HEAD") {
+        return RouteMethod::Head;
+    } else if (method == "OPTIONS") {
+        return RouteMethod::Options;
+    }
+    return std::nullopt;
+}
+
+const char* routeMethodName(RouteMethod method) {
+    switch (method) {
+        case RouteMethod::Get: return "GET";
+        case RouteMethod::Post: return "POST";
+        case RouteMethod::Put: return "PUT";
+        case RouteMethod::Patch: return "PATCH";
+        case RouteMethod::Delete: return "DELETE";
+        case RouteMethod::Head: return "HEAD";
+        case RouteMethod::Options: return "OPTIONS";
+        default: return "*";
+    }
+}
+
+} // namespace handlers
+} // namespace securapp
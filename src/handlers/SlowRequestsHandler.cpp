@@ -0,0 +1,36 @@
+#include "handlers/SlowRequestsHandler.h"
+#include "util/SlowRequestLog.h"
+
+namespace securapp {
+namespace handlers {
+
+void SlowRequestsHandler::handleRequest() {
+    auto& log = util::SlowRequestLog::getInstance();
+
+    util::ArenaJson requests = util::ArenaJson::array();
+    for (const util::SlowRequest& request : log.snapshot()) {
+        util::ArenaJson phases = util::ArenaJson::object();
+        for (size_t i = 0; i < util::kPhaseCount; i++) {
+            phases[util::phaseName(static_cast<util::Phase>(i))] = request.phaseUs[i];
+        }
+        requests.push_back({
+            {"timestamp_us", request.timestampUs},
+            {"method", request.method},
+            {"path", request.path},
+            {"status", request.status},
+            {"latency_us", request.latencyUs},
+            {"phases_us", std::move(phases)}
+        });
+    }
+
+    util::ArenaJson response = {
+        {"status", "success"},
+        {"threshold_ms", log.threshold().count()},
+        {"recorded", log.recorded()},
+        {"requests", std::move(requests)}
+    };
+    sendJsonResponse(200, response);
+}
+
+} // namespace handlers
+} // namespace securapp
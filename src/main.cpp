@@ -54,8 +54,9 @@ int main(int argc, char* argv[]) {
         FLAGS_v = 0;
     }
 
-    // Log to stderr as well
-    FLAGS_alsologtostderr = true;
+    // Echo to stderr only when debugging; per-request lines go to the
+    // access log instead
+    FLAGS_alsologtostderr = FLAGS_verbose;
 
     LOG(INFO) << "Starting Secure Application Server";
     LOG(INFO) << "Using configuration file: " << FLAGS_config;
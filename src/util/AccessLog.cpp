@@ -0,0 +1,216 @@
+#include "util/AccessLog.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <ctime>
+#include <functional>
+
+namespace securapp {
+namespace util {
+
+class AccessLog::Ring {
+public:
+    explicit Ring(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    // Producer side; false if the ring is full
+    bool push(const AccessRecord& record) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+            return false;
+        }
+        slots_[tail & mask_] = record;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; calls 'fn' for every queued record
+    template <typename F>
+    size_t popAll(F&& fn) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t count = tail - head;
+        for (; head != tail; head++) {
+            fn(slots_[head & mask_]);
+        }
+        head_.store(head, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::vector<AccessRecord> slots_;
+    size_t mask_ = 0;
+    // Separate cache lines for the consumer and producer indexes
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+namespace {
+
+// Per-thread xorshift generator for sampling decisions
+double nextRandom() {
+    thread_local uint64_t state =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<double>(state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// 2024-01-01T12:00:00.123456Z GET /api/users 200 1234us 512B
+void formatRecord(const AccessRecord& record, std::string& out) {
+    time_t seconds = static_cast<time_t>(record.timestampUs / 1000000);
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+
+    char line[256];
+    int length = std::snprintf(line, sizeof(line),
+        "%04d-%02d-%02dT%02d:%02d:%02d.%06uZ %s %s %u %uus %lluB\n",
+        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+        static_cast<unsigned>(record.timestampUs % 1000000),
+        record.method, record.path, static_cast<unsigned>(record.status),
+        static_cast<unsigned>(record.latencyUs),
+        static_cast<unsigned long long>(record.bytesOut));
+    if (length > 0) {
+        out.append(line, std::min<size_t>(length, sizeof(line) - 1));
+    }
+}
+
+} // namespace
+
+AccessLogOptions AccessLogOptions::fromConfig(const json& loggingConfig) {
+    AccessLogOptions options;
+    options.enabled = loggingConfig.value("access_log_enabled", options.enabled);
+    options.file = loggingConfig.value("access_log", options.file);
+    options.sampleRate = loggingConfig.value("access_log_sample_rate", options.sampleRate);
+    options.bufferRecords = loggingConfig.value("access_log_buffer", options.bufferRecords);
+    options.flushInterval = std::chrono::milliseconds(
+        loggingConfig.value("access_log_flush_ms", options.flushInterval.count()));
+    return options;
+}
+
+AccessLog& AccessLog::getInstance() {
+    static AccessLog instance;
+    return instance;
+}
+
+AccessLog::~AccessLog() {
+    stop();
+}
+
+bool AccessLog::start(const AccessLogOptions& options) {
+    if (running_.load() || !options.enabled) {
+        return true;
+    }
+
+    file_ = std::fopen(options.file.c_str(), "a");
+    if (!file_) {
+        LOG(ERROR) << "Failed to open access log " << options.file;
+        return false;
+    }
+
+    options_ = options;
+    stopping_ = false;
+    flusher_ = std::thread([this] { flushLoop(); });
+    running_.store(true, std::memory_order_release);
+    return true;
+}
+
+void AccessLog::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    flusher_.join();
+
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool AccessLog::sampled(uint16_t status) const {
+    if (!running_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    if (status == 0 || status >= 400 || options_.sampleRate >= 1.0) {
+        return true;
+    }
+    return nextRandom() < options_.sampleRate;
+}
+
+void AccessLog::record(const AccessRecord& record) {
+    if (!running_.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (!localRing()->push(record)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+AccessLog::Ring* AccessLog::localRing() {
+    thread_local Ring* ring = nullptr;
+    if (!ring) {
+        // Rings outlive their threads; the flusher drains them regardless
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings_.push_back(std::make_unique<Ring>(options_.bufferRecords));
+        ring = rings_.back().get();
+    }
+    return ring;
+}
+
+size_t AccessLog::drain(std::string& out) {
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    size_t count = 0;
+    for (auto& ring : rings_) {
+        count += ring->popAll([&out](const AccessRecord& record) {
+            formatRecord(record, out);
+        });
+    }
+    return count;
+}
+
+void AccessLog::flushLoop() {
+    std::string batch;
+    uint64_t reportedDrops = 0;
+
+    while (true) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wake_.wait_for(lock, options_.flushInterval, [this] { return stopping_; });
+            stopping = stopping_;
+        }
+
+        batch.clear();
+        size_t count = drain(batch);
+        if (count > 0) {
+            std::fwrite(batch.data(), 1, batch.size(), file_);
+            std::fflush(file_);
+            written_.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        uint64_t drops = dropped();
+        if (drops != reportedDrops) {
+            LOG(WARNING) << "Access log dropped " << (drops - reportedDrops)
+                         << " records (buffers full)";
+            reportedDrops = drops;
+        }
+
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,63 @@
+#include "util/Arena.h"
+
+#include <algorithm>
+
+namespace securapp {
+namespace util {
+
+thread_local Arena* Arena::current_ = nullptr;
+
+Arena::Arena(size_t blockSize) : blockSize_(blockSize) {}
+
+Arena::~Arena() {
+    for (const Block& block : blocks_) {
+        ::operator delete(block.data);
+    }
+}
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+    // Oversized requests get a block of their own
+    size_t blockSize = std::max(blockSize_, size + align);
+    char* data = static_cast<char*>(::operator new(blockSize));
+    blocks_.push_back(Block{data, blockSize});
+    cur_ = data;
+    end_ = data + blockSize;
+    return allocate(size, align);
+}
+
+bool Arena::owns(const void* p) const {
+    const char* c = static_cast<const char*>(p);
+    // Newest block first; that is where recent allocations are
+    for (auto it = blocks_.rbegin(); it != blocks_.rend(); ++it) {
+        if (c >= it->data && c < it->data + it->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Arena::reset() {
+    if (blocks_.empty()) {
+        return;
+    }
+    for (size_t i = 1; i < blocks_.size(); i++) {
+        ::operator delete(blocks_[i].data);
+    }
+    blocks_.resize(1);
+    cur_ = blocks_[0].data;
+    end_ = cur_ + blocks_[0].size;
+}
+
+size_t Arena::used() const {
+    if (blocks_.empty()) {
+        return 0;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i + 1 < blocks_.size(); i++) {
+        total += blocks_[i].size;
+    }
+    return total + (cur_ - blocks_.back().data);
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,62 @@
+#include "util/JsonEncoder.h"
+
+#include <algorithm>
+
+namespace securapp {
+namespace util {
+
+const char* contentType(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::MsgPack:
+            return "application/msgpack";
+        case Encoding::Cbor:
+            return "application/cbor";
+        default:
+            return "application/json";
+    }
+}
+
+Encoding encodingForAccept(std::string_view accept) {
+    if (accept.find("application/msgpack") != std::string_view::npos ||
+        accept.find("application/x-msgpack") != std::string_view::npos) {
+        return Encoding::MsgPack;
+    }
+    if (accept.find("application/cbor") != std::string_view::npos) {
+        return Encoding::Cbor;
+    }
+    return Encoding::Json;
+}
+
+IOBufStreamBuf::IOBufStreamBuf(size_t sizeHint, size_t growth)
+    : nextSize_(std::max<size_t>(sizeHint, 64)), growth_(growth) {}
+
+IOBufStreamBuf::int_type IOBufStreamBuf::overflow(int_type c) {
+    commit();
+
+    auto space = queue_.preallocate(1, nextSize_);
+    nextSize_ = growth_;
+    char* begin = static_cast<char*>(space.first);
+    setp(begin, begin + space.second);
+
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+void IOBufStreamBuf::commit() {
+    if (pbase() != nullptr) {
+        queue_.postallocate(pptr() - pbase());
+        setp(nullptr, nullptr);
+    }
+}
+
+std::unique_ptr<folly::IOBuf> IOBufStreamBuf::finish() {
+    commit();
+    auto result = queue_.move();
+    return result ? std::move(result) : folly::IOBuf::create(0);
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,568 @@
+#include "util/JsonStreamParser.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+
+namespace securapp {
+namespace util {
+
+namespace {
+
+// Longest number token accepted; longer ones cannot be represented anyway
+constexpr size_t kMaxNumberLength = 256;
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool isWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool isNumberChar(char c) {
+    return isDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+bool validNumber(const std::string& s) {
+    size_t i = 0;
+    size_t n = s.size();
+
+    if (i < n && s[i] == '-') {
+        i++;
+    }
+    if (i >= n) {
+        return false;
+    }
+    if (s[i] == '0') {
+        i++;
+    } else if (isDigit(s[i])) {
+        while (i < n && isDigit(s[i])) {
+            i++;
+        }
+    } else {
+        return false;
+    }
+
+    if (i < n && s[i] == '.') {
+        i++;
+        if (i >= n || !isDigit(s[i])) {
+            return false;
+        }
+        while (i < n && isDigit(s[i])) {
+            i++;
+        }
+    }
+
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < n && (s[i] == '+' || s[i] == '-')) {
+            i++;
+        }
+        if (i >= n || !isDigit(s[i])) {
+            return false;
+        }
+        while (i < n && isDigit(s[i])) {
+            i++;
+        }
+    }
+    return i == n;
+}
+
+} // namespace
+
+JsonStreamParser::JsonStreamParser(std::vector<std::string> fields, size_t maxDepth)
+    : fields_(fields.begin(), fields.end()), maxDepth_(maxDepth) {}
+
+bool JsonStreamParser::feed(const char* data, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        switch (state_) {
+            case State::Error:
+                return false;
+            case State::String:
+                i += scanString(data + i, length - i);
+                break;
+            case State::Number:
+                // Consumes nothing when the byte ends the number
+                i += scanNumber(data + i, length - i);
+                break;
+            case State::Literal:
+                if (data[i] != literal_[literalPos_]) {
+                    return fail("Invalid literal");
+                }
+                i++;
+                if (literal_[++literalPos_] == '\0') {
+                    switch (literal_[0]) {
+                        case 't': emit(true); break;
+                        case 'f': emit(false); break;
+                        default: emit(nullptr); break;
+                    }
+                }
+                break;
+            default:
+                if (!structural(data[i])) {
+                    return false;
+                }
+                i++;
+                break;
+        }
+    }
+    return state_ != State::Error;
+}
+
+bool JsonStreamParser::finish() {
+    // A top-level number has no terminator other than the end of input
+    if (state_ == State::Number) {
+        completeNumber();
+    }
+    if (state_ == State::Error) {
+        return false;
+    }
+    if (state_ != State::Done) {
+        return fail("Unexpected end of input");
+    }
+    return true;
+}
+
+bool JsonStreamParser::structural(char c) {
+    if (isWhitespace(c)) {
+        return true;
+    }
+
+    switch (state_) {
+        case State::Value:
+            beginValue(c);
+            break;
+        case State::ArrayFirst:
+            if (c == ']') {
+                closeContainer(false);
+            } else {
+                beginValue(c);
+            }
+            break;
+        case State::ObjectFirst:
+            if (c == '}') {
+                closeContainer(true);
+            } else if (c == '"') {
+                beginString(true);
+            } else {
+                fail("Expected an object key");
+            }
+            break;
+        case State::Key:
+            if (c == '"') {
+                beginString(true);
+            } else {
+                fail("Expected an object key");
+            }
+            break;
+        case State::Colon:
+            if (c == ':') {
+                state_ = State::Value;
+            } else {
+                fail("Expected ':' after an object key");
+            }
+            break;
+        case State::Comma: {
+            bool object = stack_.back().object;
+            if (c == ',') {
+                state_ = object ? State::Key : State::Value;
+            } else if (c == (object ? '}' : ']')) {
+                closeContainer(object);
+            } else {
+                fail(object ? "Expected ',' or '}'" : "Expected ',' or ']'");
+            }
+            break;
+        }
+        case State::Done:
+            fail("Unexpected data after the document");
+            break;
+        default:
+            fail("Internal parser error");
+            break;
+    }
+    return state_ != State::Error;
+}
+
+void JsonStreamParser::beginValue(char c) {
+    switch (c) {
+        case '{':
+            openContainer(true);
+            return;
+        case '[':
+            openContainer(false);
+            return;
+        case '"':
+            beginString(false);
+            return;
+        case 't':
+            literal_ = "true";
+            break;
+        case 'f':
+            literal_ = "false";
+            break;
+        case 'n':
+            literal_ = "null";
+            break;
+        default:
+            if (c == '-' || isDigit(c)) {
+                token_.assign(1, c);
+                state_ = State::Number;
+            } else {
+                fail("Unexpected character");
+            }
+            return;
+    }
+    literalPos_ = 1;
+    state_ = State::Literal;
+}
+
+void JsonStreamParser::beginString(bool key) {
+    token_.clear();
+    stringIsKey_ = key;
+    collecting_ = key || keepingValue();
+    escape_ = Escape::None;
+    highSurrogate_ = 0;
+    utf8Left_ = 0;
+    state_ = State::String;
+}
+
+void JsonStreamParser::openContainer(bool object) {
+    if (stack_.size() >= maxDepth_) {
+        fail("Document nested too deeply");
+        return;
+    }
+
+    ArenaJson* target = nullptr;
+    if (keepingValue()) {
+        ArenaJson value = object ? ArenaJson::object() : ArenaJson::array();
+        if (stack_.empty()) {
+            root_ = std::move(value);
+            target = &root_;
+        } else {
+            // The parent is not modified again until this container closes,
+            // so the pointer stays valid
+            Frame& parent = stack_.back();
+            if (parent.object) {
+                target = &((*parent.target)[parent.key] = std::move(value));
+            } else {
+                parent.target->push_back(std::move(value));
+                target = &parent.target->back();
+            }
+        }
+    }
+
+    stack_.push_back(Frame{target, object, std::string(), target != nullptr});
+    state_ = object ? State::ObjectFirst : State::ArrayFirst;
+}
+
+void JsonStreamParser::closeContainer(bool /* object */) {
+    stack_.pop_back();
+    state_ = stack_.empty() ? State::Done : State::Comma;
+}
+
+void JsonStreamParser::emit(ArenaJson&& value) {
+    if (stack_.empty()) {
+        root_ = std::move(value);
+        state_ = State::Done;
+        return;
+    }
+
+    Frame& top = stack_.back();
+    if (top.keep) {
+        if (top.object) {
+            (*top.target)[top.key] = std::move(value);
+        } else {
+            top.target->push_back(std::move(value));
+        }
+    }
+    state_ = State::Comma;
+}
+
+size_t JsonStreamParser::scanString(const char* data, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+
+        if (escape_ != Escape::None) {
+            i++;
+            if (!escapeChar(c)) {
+                return i;
+            }
+            continue;
+        }
+
+        if (utf8Left_ > 0) {
+            i++;
+            if (!utf8Byte(c)) {
+                return i;
+            }
+            if (collecting_) {
+                token_ += static_cast<char>(c);
+            }
+            continue;
+        }
+
+        // Copy runs of plain ASCII in one go
+        size_t start = i;
+        while (i < length) {
+            c = static_cast<unsigned char>(data[i]);
+            if (c < 0x20 || c == '"' || c == '\\' || c >= 0x80) {
+                break;
+            }
+            i++;
+        }
+        if (collecting_) {
+            token_.append(data + start, i - start);
+        }
+        if (i == length) {
+            break;
+        }
+
+        i++;
+        if (c == '"') {
+            completeString();
+            return i;
+        }
+        if (c == '\\') {
+            escape_ = Escape::Start;
+            continue;
+        }
+        if (c < 0x20) {
+            fail("Control character in string");
+            return i;
+        }
+
+        // Lead byte of a multi-byte UTF-8 sequence
+        if (!utf8Byte(c)) {
+            return i;
+        }
+        if (collecting_) {
+            token_ += static_cast<char>(c);
+        }
+    }
+    return i;
+}
+
+void JsonStreamParser::completeString() {
+    if (stringIsKey_) {
+        Frame& top = stack_.back();
+        top.key = std::move(token_);
+        // The field list applies to members of the top-level object
+        top.keep = top.target != nullptr &&
+                   (stack_.size() > 1 || fields_.empty() || fields_.count(top.key) > 0);
+        token_.clear();
+        state_ = State::Colon;
+        return;
+    }
+
+    emit(ArenaJson(std::move(token_)));
+    token_.clear();
+}
+
+bool JsonStreamParser::escapeChar(unsigned char c) {
+    switch (escape_) {
+        case Escape::Start: {
+            char decoded;
+            switch (c) {
+                case '"': decoded = '"'; break;
+                case '\\': decoded = '\\'; break;
+                case '/': decoded = '/'; break;
+                case 'b': decoded = '\b'; break;
+                case 'f': decoded = '\f'; break;
+                case 'n': decoded = '\n'; break;
+                case 'r': decoded = '\r'; break;
+                case 't': decoded = '\t'; break;
+                case 'u':
+                    escape_ = Escape::Hex;
+                    hexLeft_ = 4;
+                    codeUnit_ = 0;
+                    return true;
+                default:
+                    return fail("Invalid escape sequence in string");
+            }
+            if (collecting_) {
+                token_ += decoded;
+            }
+            escape_ = Escape::None;
+            return true;
+        }
+
+        case Escape::Hex: {
+            uint32_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                digit = c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                digit = c - 'A' + 10;
+            } else {
+                return fail("Invalid \\u escape in string");
+            }
+            codeUnit_ = (codeUnit_ << 4) | digit;
+            if (--hexLeft_ > 0) {
+                return true;
+            }
+
+            if (highSurrogate_ != 0) {
+                if (codeUnit_ < 0xDC00 || codeUnit_ > 0xDFFF) {
+                    return fail("Unpaired surrogate in string");
+                }
+                appendCodePoint(0x10000 + ((highSurrogate_ - 0xD800) << 10) + (codeUnit_ - 0xDC00));
+                highSurrogate_ = 0;
+                escape_ = Escape::None;
+            } else if (codeUnit_ >= 0xD800 && codeUnit_ <= 0xDBFF) {
+                // Must be followed by the low half as another \u escape
+                highSurrogate_ = codeUnit_;
+                escape_ = Escape::LowBackslash;
+            } else if (codeUnit_ >= 0xDC00 && codeUnit_ <= 0xDFFF) {
+                return fail("Unpaired surrogate in string");
+            } else {
+                appendCodePoint(codeUnit_);
+                escape_ = Escape::None;
+            }
+            return true;
+        }
+
+        case Escape::LowBackslash:
+            if (c != '\\') {
+                return fail("Unpaired surrogate in string");
+            }
+            escape_ = Escape::LowU;
+            return true;
+
+        case Escape::LowU:
+            if (c != 'u') {
+                return fail("Unpaired surrogate in string");
+            }
+            escape_ = Escape::Hex;
+            hexLeft_ = 4;
+            codeUnit_ = 0;
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+bool JsonStreamParser::utf8Byte(unsigned char c) {
+    if (utf8Left_ == 0) {
+        // Lead byte; the ranges of the next byte exclude overlong forms,
+        // surrogates and code points above U+10FFFF
+        utf8Low_ = 0x80;
+        utf8High_ = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            utf8Left_ = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            utf8Left_ = 2;
+            if (c == 0xE0) {
+                utf8Low_ = 0xA0;
+            } else if (c == 0xED) {
+                utf8High_ = 0x9F;
+            }
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            utf8Left_ = 3;
+            if (c == 0xF0) {
+                utf8Low_ = 0x90;
+            } else if (c == 0xF4) {
+                utf8High_ = 0x8F;
+            }
+        } else {
+            return fail("Invalid UTF-8 in string");
+        }
+        return true;
+    }
+
+    if (c < utf8Low_ || c > utf8High_) {
+        return fail("Invalid UTF-8 in string");
+    }
+    utf8Left_--;
+    utf8Low_ = 0x80;
+    utf8High_ = 0xBF;
+    return true;
+}
+
+void JsonStreamParser::appendCodePoint(uint32_t codePoint) {
+    if (!collecting_) {
+        return;
+    }
+    if (codePoint < 0x80) {
+        token_ += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        token_ += static_cast<char>(0xC0 | (codePoint >> 6));
+        token_ += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        token_ += static_cast<char>(0xE0 | (codePoint >> 12));
+        token_ += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        token_ += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        token_ += static_cast<char>(0xF0 | (codePoint >> 18));
+        token_ += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        token_ += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        token_ += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+size_t JsonStreamParser::scanNumber(const char* data, size_t length) {
+    size_t i = 0;
+    while (i < length && isNumberChar(data[i])) {
+        i++;
+    }
+    token_.append(data, i);
+
+    if (token_.size() > kMaxNumberLength) {
+        fail("Number too long");
+        return i;
+    }
+    if (i < length) {
+        completeNumber();
+    }
+    return i;
+}
+
+void JsonStreamParser::completeNumber() {
+    if (!validNumber(token_)) {
+        fail("Invalid number");
+        return;
+    }
+
+    bool integer = token_.find_first_of(".eE") == std::string::npos;
+    if (integer) {
+        // Same representation as json::parse: unsigned unless negative,
+        // falling back to double on overflow
+        errno = 0;
+        if (token_[0] == '-') {
+            long long value = std::strtoll(token_.c_str(), nullptr, 10);
+            if (errno != ERANGE) {
+                emit(ArenaJson(static_cast<int64_t>(value)));
+                return;
+            }
+        } else {
+            unsigned long long value = std::strtoull(token_.c_str(), nullptr, 10);
+            if (errno != ERANGE) {
+                emit(ArenaJson(static_cast<uint64_t>(value)));
+                return;
+            }
+        }
+    }
+
+    double value = std::strtod(token_.c_str(), nullptr);
+    if (!std::isfinite(value)) {
+        fail("Number out of range");
+        return;
+    }
+    emit(ArenaJson(value));
+}
+
+bool JsonStreamParser::fail(const std::string& message) {
+    if (state_ != State::Error) {
+        error_ = message;
+        state_ = State::Error;
+    }
+    return false;
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,119 @@
+#include "util/JsonView.h"
+
+namespace securapp {
+namespace util {
+
+bool JsonView::valid() const {
+#ifdef SECURAPP_HAVE_SIMDJSON
+    if (simd_) {
+        return true;
+    }
+#endif
+    return value_ != nullptr;
+}
+
+bool JsonView::isObject() const {
+#ifdef SECURAPP_HAVE_SIMDJSON
+    if (simd_) {
+        return element_.is_object();
+    }
+#endif
+    return value_ && value_->is_object();
+}
+
+bool JsonView::contains(std::string_view key) const {
+#ifdef SECURAPP_HAVE_SIMDJSON
+    if (simd_) {
+        return element_.is_object() && !element_[key].error();
+    }
+#endif
+    return value_ && value_->is_object() && value_->find(key) != value_->end();
+}
+
+std::optional<std::string_view> JsonView::getString(std::string_view key) const {
+#ifdef SECURAPP_HAVE_SIMDJSON
+    if (simd_) {
+        std::string_view result;
+        if (!element_.is_object() || element_[key].get_string().get(result)) {
+            return std::nullopt;
+        }
+        return result;
+    }
+#endif
+    if (!value_ || !value_->is_object()) {
+        return std::nullopt;
+    }
+    auto it = value_->find(key);
+    if (it == value_->end() || !it->is_string()) {
+        return std::nullopt;
+    }
+    return std::string_view(it->get_ref<const std::string&>());
+}
+
+std::optional<int64_t> JsonView::getInt(std::string_view key) const {
+#ifdef SECURAPP_HAVE_SIMDJSON
+    if (simd_) {
+        int64_t result;
+        if (!element_.is_object() || element_[key].get_int64().get(result)) {
+            return std::nullopt;
+        }
+        return result;
+    }
+#endif
+    if (!value_ || !value_->is_object()) {
+        return std::nullopt;
+    }
+    auto it = value_->find(key);
+    if (it == value_->end() || !it->is_number_integer()) {
+        return std::nullopt;
+    }
+    return it->get<int64_t>();
+}
+
+std::optional<bool> JsonView::getBool(std::string_view key) const {
+#ifdef SECURAPP_HAVE_SIMDJSON
+    if (simd_) {
+        bool result;
+        if (!element_.is_object() || element_[key].get_bool().get(result)) {
+            return std::nullopt;
+        }
+        return result;
+    }
+#endif
+    if (!value_ || !value_->is_object()) {
+        return std::nullopt;
+    }
+    auto it = value_->find(key);
+    if (it == value_->end() || !it->is_boolean()) {
+        return std::nullopt;
+    }
+    return it->get<bool>();
+}
+
+json JsonView::toJson() const {
+#ifdef SECURAPP_HAVE_SIMDJSON
+    if (simd_) {
+        return json::parse(simdjson::minify(element_));
+    }
+#endif
+    return value_ ? json(*value_) : json();
+}
+
+#ifdef SECURAPP_HAVE_SIMDJSON
+bool parseSimdJson(const uint8_t* data, size_t length, JsonView& view, std::string& error) {
+    // Parsers keep their buffers between documents, so reuse one per thread
+    thread_local simdjson::dom::parser parser;
+
+    simdjson::dom::element element;
+    auto code = parser.parse(data, length, false).get(element);
+    if (code) {
+        error = simdjson::error_message(code);
+        return false;
+    }
+    view = JsonView(element);
+    return true;
+}
+#endif
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,261 @@
+#include "util/Jwt.h"
+#include <glog/logging.h>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+namespace securapp {
+namespace util {
+
+namespace {
+
+constexpr int kBase64Variant = sodium_base64_VARIANT_URLSAFE_NO_PADDING;
+
+// Largest decoded payload accepted
+constexpr size_t kMaxPayload = 384;
+
+// A token the calling thread verified recently
+struct VerifiedToken {
+    size_t length = 0;
+    char token[Jwt::kMaxTokenLength];
+    JwtClaims claims;
+};
+
+// Direct-mapped by hash; a new token simply replaces the one in its slot
+constexpr size_t kVerifiedSlots = 256;
+using VerifiedCache = std::array<VerifiedToken, kVerifiedSlots>;
+
+VerifiedCache& localVerified() {
+    thread_local std::unique_ptr<VerifiedCache> cache = std::make_unique<VerifiedCache>();
+    return *cache;
+}
+
+int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string encode(const void* data, size_t length) {
+    std::string out(sodium_base64_ENCODED_LEN(length, kBase64Variant), '\0');
+    sodium_bin2base64(&out[0], out.size(), static_cast<const unsigned char*>(data), length,
+                      kBase64Variant);
+    out.resize(std::strlen(out.c_str()));
+    return out;
+}
+
+// Decode into 'out'; false if 'in' is not base64url or does not fit
+bool decode(std::string_view in, unsigned char* out, size_t capacity, size_t& length) {
+    return sodium_base642bin(out, capacity, in.data(), in.size(), nullptr, &length,
+                             nullptr, kBase64Variant) == 0;
+}
+
+// Read the claims of a payload this server signed: a flat object of
+// integers and strings without escapes
+bool parseClaims(std::string_view payload, JwtClaims& claims) {
+    size_t pos = 0;
+    auto consume = [&](char c) {
+        if (pos < payload.size() && payload[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    };
+    auto readString = [&](std::string_view& out) {
+        if (!consume('"')) {
+            return false;
+        }
+        size_t end = payload.find('"', pos);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        out = payload.substr(pos, end - pos);
+        pos = end + 1;
+        return out.find('\\') == std::string_view::npos;
+    };
+    auto toInt = [](std::string_view text, int64_t& out) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    };
+
+    bool haveSubject = false;
+    bool haveExpiry = false;
+    if (!consume('{')) {
+        return false;
+    }
+    do {
+        std::string_view key;
+        if (!readString(key) || !consume(':')) {
+            return false;
+        }
+
+        std::string_view value;
+        if (pos < payload.size() && payload[pos] == '"') {
+            if (!readString(value)) {
+                return false;
+            }
+        } else {
+            size_t end = payload.find_first_of(",}", pos);
+            if (end == std::string_view::npos) {
+                return false;
+            }
+            value = payload.substr(pos, end - pos);
+            pos = end;
+        }
+
+        if (key == "sub") {
+            haveSubject = toInt(value, claims.userId);
+            if (!haveSubject) {
+                return false;
+            }
+        } else if (key == "exp") {
+            haveExpiry = toInt(value, claims.expiresAt);
+            if (!haveExpiry) {
+                return false;
+            }
+        } else if (key == "iat" && !toInt(value, claims.issuedAt)) {
+            return false;
+        }
+    } while (consume(','));
+
+    return consume('}') && pos == payload.size() && haveSubject && haveExpiry;
+}
+
+} // namespace
+
+JwtOptions JwtOptions::fromConfig(const json& securityConfig) {
+    JwtOptions options;
+    options.secret = securityConfig.value("jwt_secret", options.secret);
+    options.lifetime = std::chrono::seconds(
+        securityConfig.value("jwt_expiration", options.lifetime.count()));
+    options.checkRevocation = securityConfig.value("jwt_check_revocation", options.checkRevocation);
+    return options;
+}
+
+Jwt& Jwt::getInstance() {
+    static Jwt instance;
+    return instance;
+}
+
+bool Jwt::configure(const JwtOptions& options) {
+    if (options.secret.empty()) {
+        LOG(ERROR) << "security.jwt_secret is not set";
+        return false;
+    }
+    if (options.secret.size() < 32) {
+        LOG(WARNING) << "security.jwt_secret is shorter than 32 bytes";
+    }
+
+    options_ = options;
+    crypto_auth_hmacsha256_init(&keyed_,
+        reinterpret_cast<const unsigned char*>(options_.secret.data()), options_.secret.size());
+
+    static constexpr std::string_view kHeader = R"({"alg":"HS256","typ":"JWT"})";
+    header_ = encode(kHeader.data(), kHeader.size());
+    return true;
+}
+
+std::string Jwt::issue(int64_t userId) const {
+    // Unique id, so tokens issued in the same second differ
+    unsigned char id[16];
+    randombytes_buf(id, sizeof(id));
+    char idHex[sizeof(id) * 2 + 1];
+    sodium_bin2hex(idHex, sizeof(idHex), id, sizeof(id));
+
+    int64_t now = nowSeconds();
+    char payload[160];
+    int length = std::snprintf(payload, sizeof(payload),
+        R"({"sub":"%lld","iat":%lld,"exp":%lld,"jti":"%s"})",
+        static_cast<long long>(userId), static_cast<long long>(now),
+        static_cast<long long>(now + options_.lifetime.count()), idHex);
+
+    std::string token = header_;
+    token += '.';
+    token += encode(payload, static_cast<size_t>(length));
+
+    unsigned char mac[crypto_auth_hmacsha256_BYTES];
+    sign(token, mac);
+    token += '.';
+    token += encode(mac, sizeof(mac));
+    return token;
+}
+
+bool Jwt::verify(std::string_view token, JwtClaims& claims) const {
+    if (token.empty() || token.size() > kMaxTokenLength) {
+        return false;
+    }
+
+    // Constant-time compare: the slot may hold another client's token
+    VerifiedToken& slot = localVerified()[std::hash<std::string_view>()(token) % kVerifiedSlots];
+    if (slot.length == token.size() &&
+        sodium_memcmp(slot.token, token.data(), token.size()) == 0) {
+        if (slot.claims.expiresAt <= nowSeconds()) {
+            return false;
+        }
+        claims = slot.claims;
+        return true;
+    }
+
+    if (!verifySlow(token, claims)) {
+        return false;
+    }
+    std::memcpy(slot.token, token.data(), token.size());
+    slot.length = token.size();
+    slot.claims = claims;
+    return true;
+}
+
+void Jwt::sign(std::string_view data, unsigned char* mac) const {
+    crypto_auth_hmacsha256_state state = keyed_;
+    crypto_auth_hmacsha256_update(&state, reinterpret_cast<const unsigned char*>(data.data()),
+                                  data.size());
+    crypto_auth_hmacsha256_final(&state, mac);
+}
+
+bool Jwt::verifySlow(std::string_view token, JwtClaims& claims) const {
+    size_t headerEnd = token.find('.');
+    if (headerEnd == std::string_view::npos) {
+        return false;
+    }
+    size_t payloadEnd = token.find('.', headerEnd + 1);
+    if (payloadEnd == std::string_view::npos ||
+        token.find('.', payloadEnd + 1) != std::string_view::npos) {
+        return false;
+    }
+
+    // Anything but our own header (e.g. "alg":"none") is refused outright
+    if (token.substr(0, headerEnd) != header_) {
+        return false;
+    }
+
+    unsigned char signature[crypto_auth_hmacsha256_BYTES];
+    size_t signatureLength = 0;
+    if (!decode(token.substr(payloadEnd + 1), signature, sizeof(signature), signatureLength) ||
+        signatureLength != sizeof(signature)) {
+        return false;
+    }
+
+    unsigned char expected[crypto_auth_hmacsha256_BYTES];
+    sign(token.substr(0, payloadEnd), expected);
+    if (sodium_memcmp(signature, expected, sizeof(expected)) != 0) {
+        return false;
+    }
+
+    unsigned char payload[kMaxPayload];
+    size_t payloadLength = 0;
+    if (!decode(token.substr(headerEnd + 1, payloadEnd - headerEnd - 1), payload, sizeof(payload),
+                payloadLength)) {
+        return false;
+    }
+
+    claims = JwtClaims();
+    if (!parseClaims(std::string_view(reinterpret_cast<const char*>(payload), payloadLength), claims)) {
+        return false;
+    }
+    return claims.expiresAt > nowSeconds();
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,232 @@
+#include "util/LoopMonitor.h"
+#include "util/Metrics.h"
+
+#include <glog/logging.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <cstdlib>
+#include <sstream>
+
+namespace securapp {
+namespace util {
+
+namespace {
+
+// Signal used to make a blocked thread record its own stack
+const int kTraceSignal = SIGRTMIN + 3;
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+thread_local LoopMonitor::LoopState* LoopMonitor::localState_ = nullptr;
+thread_local LoopMonitor::Probe* LoopMonitor::localProbe_ = nullptr;
+
+// Timer on the monitored loop. It is due every interval; the delay between
+// when it was due and when it ran is the time callbacks kept the loop busy.
+class LoopMonitor::Probe : public folly::AsyncTimeout {
+public:
+    Probe(folly::EventBase* evb, LoopState* state, std::chrono::milliseconds interval)
+        : folly::AsyncTimeout(evb), state_(state), interval_(interval) {}
+
+    void arm() {
+        dueUs_ = nowUs() + std::chrono::duration_cast<std::chrono::microseconds>(interval_).count();
+        scheduleTimeout(static_cast<uint32_t>(interval_.count()));
+    }
+
+    void timeoutExpired() noexcept override {
+        int64_t now = nowUs();
+        int64_t lag = now - dueUs_;
+        Metrics::getInstance().observe(state_->lagHistogram, lag > 0 ? lag : 0);
+        state_->lastBeatUs.store(now, std::memory_order_relaxed);
+        arm();
+    }
+
+private:
+    LoopState* state_;
+    std::chrono::milliseconds interval_;
+    int64_t dueUs_ = 0;
+};
+
+LoopMonitorOptions LoopMonitorOptions::fromConfig(const json& monitorConfig) {
+    LoopMonitorOptions options;
+    options.enabled = monitorConfig.value("enabled", options.enabled);
+    options.interval = std::chrono::milliseconds(
+        monitorConfig.value("interval_ms", options.interval.count()));
+    options.stallThreshold = std::chrono::milliseconds(
+        monitorConfig.value("stall_threshold_ms", options.stallThreshold.count()));
+    return options;
+}
+
+LoopMonitor& LoopMonitor::getInstance() {
+    static LoopMonitor instance;
+    return instance;
+}
+
+LoopMonitor::~LoopMonitor() {
+    stop();
+}
+
+void LoopMonitor::start(const LoopMonitorOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_ || !options.enabled) {
+        return;
+    }
+    options_ = options;
+
+    struct sigaction action = {};
+    action.sa_handler = &LoopMonitor::onTraceSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(kTraceSignal, &action, nullptr);
+
+    // The first backtrace() loads the unwinder, which allocates; do that
+    // here rather than inside the signal handler
+    void* warmup[2];
+    backtrace(warmup, 2);
+
+    stallCounter_ = Metrics::getInstance().counter("event_loop_stalls_total", "",
+        "Times an event loop was blocked longer than the stall threshold");
+
+    stopping_ = false;
+    running_ = true;
+    watchdog_ = std::thread([this] { watchLoop(); });
+}
+
+void LoopMonitor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    watchdog_.join();
+}
+
+void LoopMonitor::attach(folly::EventBase* evb) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || localProbe_) {
+        return;
+    }
+
+    auto state = std::make_unique<LoopState>();
+    state->index = loops_.size();
+    state->thread = pthread_self();
+    state->lagHistogram = Metrics::getInstance().histogram("event_loop_lag_seconds",
+        "loop=\"" + std::to_string(state->index) + "\"",
+        "Delay between when a loop's probe timer was due and when it ran");
+    state->lastBeatUs.store(nowUs());
+
+    localState_ = state.get();
+    loops_.push_back(std::move(state));
+
+    localProbe_ = new Probe(evb, localState_, options_.interval);
+    localProbe_->arm();
+}
+
+void LoopMonitor::detach() {
+    if (!localProbe_) {
+        return;
+    }
+    localProbe_->cancelTimeout();
+    delete localProbe_;
+    localProbe_ = nullptr;
+
+    // The state stays allocated; the watchdog may still be looking at it
+    localState_->active.store(false);
+    localState_ = nullptr;
+}
+
+LoopMonitor::Activity::Activity(const char* label) {
+    LoopState* state = localState_;
+    slot_ = state ? &state->activity : nullptr;
+    if (slot_) {
+        previous_ = slot_->load(std::memory_order_relaxed);
+        slot_->store(label, std::memory_order_relaxed);
+    }
+}
+
+LoopMonitor::Activity::~Activity() {
+    if (slot_) {
+        slot_->store(previous_, std::memory_order_relaxed);
+    }
+}
+
+void LoopMonitor::onTraceSignal(int /* signum */) {
+    LoopState* state = localState_;
+    if (state && state->traceState.load() == 1) {
+        state->frameCount = backtrace(state->frames, kMaxFrames);
+        state->traceState.store(2);
+    }
+}
+
+void LoopMonitor::watchLoop() {
+    const int64_t intervalUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        options_.interval).count();
+    const int64_t thresholdUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        options_.stallThreshold).count();
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            if (wake_.wait_for(lock, options_.interval, [this] { return stopping_; })) {
+                return;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = nowUs();
+        for (auto& state : loops_) {
+            if (!state->active.load()) {
+                continue;
+            }
+            int64_t beat = state->lastBeatUs.load(std::memory_order_relaxed);
+            int64_t stalled = now - beat - intervalUs;
+            if (stalled > thresholdUs && beat != state->reportedBeatUs) {
+                state->reportedBeatUs = beat;
+                reportStall(*state, stalled);
+            }
+        }
+    }
+}
+
+void LoopMonitor::reportStall(LoopState& state, int64_t stalledUs) {
+    Metrics::getInstance().add(stallCounter_);
+
+    // Ask the blocked thread for its stack and give it a moment to answer
+    state.frameCount = 0;
+    state.traceState.store(1);
+    if (pthread_kill(state.thread, kTraceSignal) == 0) {
+        for (int i = 0; i < 100 && state.traceState.load() != 2; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    bool traced = state.traceState.exchange(0) == 2;
+
+    const char* activity = state.activity.load(std::memory_order_relaxed);
+    std::ostringstream report;
+    report << "Event loop " << state.index << " blocked for " << stalledUs / 1000 << "ms"
+           << " while handling " << (activity ? activity : "(no request)");
+
+    if (traced && state.frameCount > 0) {
+        char** symbols = backtrace_symbols(state.frames, state.frameCount);
+        report << "\n";
+        for (int i = 0; i < state.frameCount; i++) {
+            report << "    #" << i << " " << (symbols ? symbols[i] : "?") << "\n";
+        }
+        std::free(symbols);
+    }
+    LOG(WARNING) << report.str();
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,25 @@
+#include "util/LoopObserver.h"
+#include "util/Metrics.h"
+
+namespace securapp {
+namespace util {
+
+LoopObserver::LoopObserver() {
+    auto& metrics = Metrics::getInstance();
+    busyHistogram_ = metrics.histogram("event_loop_busy_seconds", "",
+        "Time an IO thread spent handling events in one loop iteration");
+    iterations_ = metrics.counter("event_loop_iterations_total", "",
+        "Event loop iterations across IO threads");
+    idleMicros_ = metrics.counter("event_loop_idle_microseconds_total", "",
+        "Time IO threads spent waiting for events");
+}
+
+void LoopObserver::loopSample(int64_t busyTime, int64_t idleTime) {
+    auto& metrics = Metrics::getInstance();
+    metrics.observe(busyHistogram_, static_cast<uint64_t>(busyTime > 0 ? busyTime : 0));
+    metrics.add(iterations_);
+    metrics.add(idleMicros_, static_cast<uint64_t>(idleTime > 0 ? idleTime : 0));
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,290 @@
+#include "util/Metrics.h"
+
+#include <cstdio>
+
+namespace securapp {
+namespace util {
+
+namespace {
+
+// Exported Prometheus buckets, in microseconds
+constexpr uint64_t kExportBoundsUs[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+inline void bump(std::atomic<uint64_t>& cell, uint64_t delta) {
+    // Single writer: no read-modify-write instruction needed
+    cell.store(cell.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+void appendNumber(std::string& out, double value) {
+    char buf[32];
+    int length = std::snprintf(buf, sizeof(buf), "%.17g", value);
+    out.append(buf, length);
+}
+
+void appendSeries(std::string& out, const std::string& name, const std::string& suffix,
+                  const std::string& labels, const std::string& extraLabel) {
+    out += name;
+    out += suffix;
+    if (!labels.empty() || !extraLabel.empty()) {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && !extraLabel.empty()) {
+            out += ',';
+        }
+        out += extraLabel;
+        out += '}';
+    }
+    out += ' ';
+}
+
+void appendHeader(std::string& out, const std::string& name, const char* type,
+                  const std::string& help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+} // namespace
+
+size_t HistogramLayout::bucketFor(uint64_t value) {
+    if (value < kSubBuckets) {
+        return static_cast<size_t>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > kMaxExponent) {
+        return kBuckets - 1;
+    }
+    uint64_t sub = (value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+    return static_cast<size_t>((exponent - kSubBucketBits + 1) * kSubBuckets + sub);
+}
+
+uint64_t HistogramLayout::upperBound(size_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket + 1;
+    }
+    int exponent = static_cast<int>(bucket / kSubBuckets) + kSubBucketBits - 1;
+    uint64_t sub = bucket % kSubBuckets;
+    return (kSubBuckets + sub + 1) << (exponent - kSubBucketBits);
+}
+
+Metrics::Shard::~Shard() {
+    for (auto& cells : histograms) {
+        delete cells.load();
+    }
+}
+
+Metrics& Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+size_t Metrics::registerSeries(std::vector<Series>& series, size_t limit,
+                               const std::string& name, const std::string& labels,
+                               const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string key = name + '{' + labels + '}';
+    auto it = ids_.find(key);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+    if (series.size() >= limit) {
+        return kInvalid;
+    }
+    series.push_back(Series{name, labels, help});
+    ids_.emplace(std::move(key), series.size() - 1);
+    return series.size() - 1;
+}
+
+size_t Metrics::counter(const std::string& name, const std::string& labels, const std::string& help) {
+    return registerSeries(counters_, kMaxCounters, name, labels, help);
+}
+
+size_t Metrics::histogram(const std::string& name, const std::string& labels, const std::string& help) {
+    return registerSeries(histograms_, kMaxHistograms, name, labels, help);
+}
+
+Metrics::Shard& Metrics::localShard() {
+    thread_local Shard* shard = nullptr;
+    if (!shard) {
+        // Shards outlive their threads so scrapes keep their counts
+        std::lock_guard<std::mutex> lock(mutex_);
+        shards_.push_back(std::make_unique<Shard>());
+        shard = shards_.back().get();
+    }
+    return *shard;
+}
+
+void Metrics::add(size_t counterId, uint64_t delta) {
+    if (counterId >= kMaxCounters) {
+        return;
+    }
+    bump(localShard().counters[counterId], delta);
+}
+
+void Metrics::observe(size_t histogramId, uint64_t micros) {
+    if (histogramId >= kMaxHistograms) {
+        return;
+    }
+    auto& slot = localShard().histograms[histogramId];
+    HistogramCells* cells = slot.load(std::memory_order_relaxed);
+    if (!cells) {
+        cells = new HistogramCells();
+        slot.store(cells, std::memory_order_release);
+    }
+    bump(cells->buckets[HistogramLayout::bucketFor(micros)], 1);
+    bump(cells->sum, micros);
+}
+
+void Metrics::render(std::string& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::string family;
+    for (size_t id = 0; id < counters_.size(); id++) {
+        const Series& series = counters_[id];
+        if (series.name != family) {
+            family = series.name;
+            appendHeader(out, family, "counter", series.help);
+        }
+        uint64_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard->counters[id].load(std::memory_order_relaxed);
+        }
+        appendSeries(out, series.name, "", series.labels, "");
+        out += std::to_string(total);
+        out += '\n';
+    }
+
+    std::array<uint64_t, HistogramLayout::kBuckets> buckets;
+    family.clear();
+    for (size_t id = 0; id < histograms_.size(); id++) {
+        const Series& series = histograms_[id];
+        if (series.name != family) {
+            family = series.name;
+            appendHeader(out, family, "histogram", series.help);
+        }
+
+        uint64_t sum = merge(id, buckets);
+
+        // A fine bucket counts towards an exported bound once all of its
+        // values are at or below it
+        uint64_t cumulative = 0;
+        size_t b = 0;
+        for (uint64_t bound : kExportBoundsUs) {
+            while (b < HistogramLayout::kBuckets && HistogramLayout::upperBound(b) - 1 <= bound) {
+                cumulative += buckets[b++];
+            }
+            char le[32];
+            std::snprintf(le, sizeof(le), "le=\"%g\"", bound / 1e6);
+            appendSeries(out, series.name, "_bucket", series.labels, le);
+            out += std::to_string(cumulative);
+            out += '\n';
+        }
+        while (b < HistogramLayout::kBuckets) {
+            cumulative += buckets[b++];
+        }
+        appendSeries(out, series.name, "_bucket", series.labels, "le=\"+Inf\"");
+        out += std::to_string(cumulative);
+        out += '\n';
+        appendSeries(out, series.name, "_sum", series.labels, "");
+        appendNumber(out, sum / 1e6);
+        out += '\n';
+        appendSeries(out, series.name, "_count", series.labels, "");
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+}
+
+uint64_t Metrics::merge(size_t id, std::array<uint64_t, HistogramLayout::kBuckets>& buckets) const {
+    buckets.fill(0);
+    uint64_t sum = 0;
+    for (const auto& shard : shards_) {
+        const HistogramCells* cells = shard->histograms[id].load(std::memory_order_acquire);
+        if (!cells) {
+            continue;
+        }
+        for (size_t b = 0; b < HistogramLayout::kBuckets; b++) {
+            buckets[b] += cells->buckets[b].load(std::memory_order_relaxed);
+        }
+        sum += cells->sum.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+void Metrics::renderQuantiles(std::string& out, const std::string& histogramName,
+                              const std::string& name, const std::string& help,
+                              const std::vector<double>& quantiles) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    appendHeader(out, name, "gauge", help);
+
+    std::array<uint64_t, HistogramLayout::kBuckets> buckets;
+    for (size_t id = 0; id < histograms_.size(); id++) {
+        const Series& series = histograms_[id];
+        if (series.name != histogramName) {
+            continue;
+        }
+        merge(id, buckets);
+        uint64_t count = 0;
+        for (uint64_t n : buckets) {
+            count += n;
+        }
+
+        for (double q : quantiles) {
+            // Report the top of the bucket holding the q-th sample
+            uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+            uint64_t seen = 0;
+            uint64_t value = 0;
+            for (size_t b = 0; b < HistogramLayout::kBuckets && count > 0; b++) {
+                seen += buckets[b];
+                if (seen >= rank && seen > 0) {
+                    value = HistogramLayout::upperBound(b) - 1;
+                    break;
+                }
+            }
+            char label[32];
+            std::snprintf(label, sizeof(label), "quantile=\"%g\"", q);
+            appendSeries(out, name, "", series.labels, label);
+            appendNumber(out, value / 1e6);
+            out += '\n';
+        }
+    }
+}
+
+void Metrics::writeValue(std::string& out, const std::string& name, const char* type,
+                         const std::string& help, double value) {
+    appendHeader(out, name, type, help);
+    appendSeries(out, name, "", "", "");
+    appendNumber(out, value);
+    out += '\n';
+}
+
+RouteMetrics::RouteMetrics(const std::string& method, const std::string& route)
+    : name_(method + " " + route) {
+    static const char* const kClasses[] = {"aborted", "1xx", "2xx", "3xx", "4xx", "5xx"};
+    auto& metrics = Metrics::getInstance();
+    for (size_t i = 0; i < histograms_.size(); i++) {
+        histograms_[i] = metrics.histogram(
+            "http_request_duration_seconds",
+            "method=\"" + method + "\",route=\"" + route + "\",status=\"" + kClasses[i] + "\"",
+            "Time from request headers to the end of the response");
+    }
+}
+
+void RouteMetrics::record(uint16_t status, uint64_t micros) const {
+    size_t statusClass = status / 100;
+    if (statusClass >= histograms_.size()) {
+        statusClass = 0;
+    }
+    Metrics::getInstance().observe(histograms_[statusClass], micros);
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,147 @@
+#include "util/PasswordHasher.h"
+#include <glog/logging.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
+#include <crypt.h>
+#include <sodium.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace securapp {
+namespace util {
+
+namespace {
+
+// crypt_rn scratch space of the calling pool thread (about 32KB)
+crypt_data* localCryptData() {
+    thread_local std::unique_ptr<crypt_data> data = std::make_unique<crypt_data>();
+    return data.get();
+}
+
+// crypt_rn failure results start with '*'
+bool cryptFailed(const char* result) {
+    return !result || result[0] == '*';
+}
+
+} // namespace
+
+PasswordHashOptions PasswordHashOptions::fromConfig(const json& securityConfig) {
+    PasswordHashOptions options;
+    options.cost = securityConfig.value("bcrypt_cost", options.cost);
+    options.threads = securityConfig.value("hash_threads", options.threads);
+    options.maxQueued = securityConfig.value("hash_queue_limit", options.maxQueued);
+    return options;
+}
+
+PasswordHasher& PasswordHasher::getInstance() {
+    static PasswordHasher instance;
+    return instance;
+}
+
+PasswordHasher::~PasswordHasher() {
+    stop();
+}
+
+bool PasswordHasher::start(const PasswordHashOptions& options) {
+    if (options.cost < 4 || options.cost > 31) {
+        LOG(ERROR) << "bcrypt_cost must be between 4 and 31, got " << options.cost;
+        return false;
+    }
+    options_ = options;
+
+    try {
+        dummyHash_ = hashNow("placeholder password");
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "bcrypt is not available: " << e.what();
+        return false;
+    }
+
+    size_t threads = options_.threads;
+    if (threads == 0) {
+        threads = std::max<size_t>(1, std::thread::hardware_concurrency() / 2);
+    }
+    capacity_ = threads + options_.maxQueued;
+    executor_ = std::make_unique<folly::CPUThreadPoolExecutor>(
+        threads, std::make_shared<folly::NamedThreadFactory>("PasswordHash"));
+
+    LOG(INFO) << "Password hashing on " << threads << " threads, bcrypt cost "
+              << options_.cost << ", at most " << options_.maxQueued << " queued";
+    return true;
+}
+
+void PasswordHasher::stop() {
+    if (executor_) {
+        executor_->join();
+        executor_.reset();
+    }
+}
+
+bool PasswordHasher::admit() {
+    size_t current = inFlight_.load(std::memory_order_relaxed);
+    do {
+        if (current >= capacity_) {
+            return false;
+        }
+    } while (!inFlight_.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+    return true;
+}
+
+folly::SemiFuture<std::string> PasswordHasher::hash(std::string password) {
+    if (!executor_) {
+        return folly::makeSemiFuture<std::string>(std::runtime_error("Password hasher is not running"));
+    }
+    if (!admit()) {
+        return folly::makeSemiFuture<std::string>(HashingOverloaded());
+    }
+
+    return folly::via(executor_.get(), [this, password = std::move(password)] {
+            return hashNow(password);
+        })
+        .ensure([this] { inFlight_.fetch_sub(1, std::memory_order_relaxed); })
+        .semi();
+}
+
+folly::SemiFuture<bool> PasswordHasher::verify(std::string password, std::string storedHash) {
+    if (!executor_) {
+        return folly::makeSemiFuture<bool>(std::runtime_error("Password hasher is not running"));
+    }
+    if (!admit()) {
+        return folly::makeSemiFuture<bool>(HashingOverloaded());
+    }
+
+    return folly::via(executor_.get(), [this, password = std::move(password),
+                                        storedHash = std::move(storedHash)] {
+            return verifyNow(password, storedHash);
+        })
+        .ensure([this] { inFlight_.fetch_sub(1, std::memory_order_relaxed); })
+        .semi();
+}
+
+std::string PasswordHasher::hashNow(const std::string& password) const {
+    char salt[CRYPT_GENSALT_OUTPUT_SIZE];
+    if (!crypt_gensalt_rn("$2b$", options_.cost, nullptr, 0, salt, sizeof(salt))) {
+        throw std::runtime_error("Failed to generate a bcrypt salt");
+    }
+
+    const char* result = crypt_rn(password.c_str(), salt, localCryptData(), sizeof(crypt_data));
+    if (cryptFailed(result)) {
+        throw std::runtime_error("bcrypt hashing failed");
+    }
+    return result;
+}
+
+bool PasswordHasher::verifyNow(const std::string& password, const std::string& storedHash) const {
+    const std::string& setting = storedHash.empty() ? dummyHash_ : storedHash;
+    const char* result = crypt_rn(password.c_str(), setting.c_str(), localCryptData(), sizeof(crypt_data));
+    if (cryptFailed(result)) {
+        // Not a hash crypt understands
+        return false;
+    }
+
+    size_t length = std::strlen(result);
+    return !storedHash.empty() && length == setting.size() &&
+           sodium_memcmp(result, setting.data(), length) == 0;
+}
+
+} // namespace util
+} // namespace securapp
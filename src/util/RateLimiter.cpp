@@ -0,0 +1,65 @@
+#include "util/RateLimiter.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace securapp {
+namespace util {
+
+RateLimitOptions RateLimitOptions::fromConfig(const json& rateLimitConfig) {
+    RateLimitOptions options;
+    options.enabled = rateLimitConfig.value("enabled", options.enabled);
+    options.requestsPerMinute = rateLimitConfig.value("requests_per_minute", options.requestsPerMinute);
+    options.burst = rateLimitConfig.value("burst", options.requestsPerMinute);
+    options.maxClients = rateLimitConfig.value("max_clients", options.maxClients);
+    return options;
+}
+
+RateLimiter::RateLimiter(const RateLimitOptions& options)
+    : tokensPerUs_(std::max<uint32_t>(options.requestsPerMinute, 1) / 60e6),
+      burst_(std::max<uint32_t>(options.burst ? options.burst : options.requestsPerMinute, 1)) {
+    size_t shardCapacity = std::max<size_t>(options.maxClients / kShards, 1);
+    for (auto& shard : shards_) {
+        shard = std::make_unique<Shard>(shardCapacity);
+    }
+}
+
+bool RateLimiter::allow(std::string_view key, std::chrono::seconds& retryAfter) {
+    // High bits pick the shard, the whole hash identifies the client
+    uint64_t hash = std::hash<std::string_view>()(key);
+    Shard& shard = *shards_[(hash >> 32) % kShards];
+    int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    bool inserted;
+    Bucket& bucket = shard.buckets.findOrInsert(hash, inserted);
+    if (inserted) {
+        // New (or forgotten) clients start with a full bucket
+        bucket.tokens = burst_;
+        bucket.updatedUs = nowUs;
+    }
+
+    bucket.tokens = std::min(burst_, bucket.tokens + (nowUs - bucket.updatedUs) * tokensPerUs_);
+    bucket.updatedUs = nowUs;
+    if (bucket.tokens >= 1.0) {
+        bucket.tokens -= 1.0;
+        return true;
+    }
+
+    double waitUs = (1.0 - bucket.tokens) / tokensPerUs_;
+    retryAfter = std::chrono::seconds(std::max<int64_t>(1, static_cast<int64_t>(std::ceil(waitUs / 1e6))));
+    return false;
+}
+
+size_t RateLimiter::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->buckets.size();
+    }
+    return total;
+}
+
+} // namespace util
+} // namespace securapp
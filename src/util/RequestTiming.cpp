@@ -0,0 +1,49 @@
+#include "util/RequestTiming.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace securapp {
+namespace util {
+
+namespace {
+
+// Append "name;dur=1.234" with a separator if needed
+void appendMetric(std::string& out, const char* name, std::chrono::steady_clock::duration spent) {
+    char item[48];
+    double ms = std::chrono::duration<double, std::milli>(spent).count();
+    int length = std::snprintf(item, sizeof(item), "%s%s;dur=%.3f",
+                               out.empty() ? "" : ", ", name, ms);
+    if (length > 0) {
+        out.append(item, std::min<size_t>(length, sizeof(item) - 1));
+    }
+}
+
+} // namespace
+
+const char* phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::Route: return "route";
+        case Phase::Body: return "body";
+        case Phase::Parse: return "parse";
+        case Phase::DbWait: return "db-wait";
+        case Phase::Db: return "db";
+        case Phase::Serialize: return "serialize";
+        case Phase::Send: return "send";
+        default: return "unknown";
+    }
+}
+
+std::string RequestTiming::serverTiming(Clock::duration total) const {
+    std::string out;
+    out.reserve(160);
+    for (size_t i = 0; i < kPhaseCount; i++) {
+        if (spent_[i] > Clock::duration::zero()) {
+            appendMetric(out, phaseName(static_cast<Phase>(i)), spent_[i]);
+        }
+    }
+    appendMetric(out, "total", total);
+    return out;
+}
+
+} // namespace util
+} // namespace securapp
@@ -0,0 +1,73 @@
+#include "util/SlowRequestLog.h"
+#include <glog/logging.h>
+
+namespace securapp {
+namespace util {
+
+SlowRequestOptions SlowRequestOptions::fromConfig(const json& slowConfig) {
+    SlowRequestOptions options;
+    options.enabled = slowConfig.value("enabled", options.enabled);
+    options.threshold = std::chrono::milliseconds(
+        slowConfig.value("threshold_ms", options.threshold.count()));
+    options.capacity = slowConfig.value("buffer", options.capacity);
+    return options;
+}
+
+SlowRequestLog& SlowRequestLog::getInstance() {
+    static SlowRequestLog instance;
+    return instance;
+}
+
+void SlowRequestLog::configure(const SlowRequestOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ring_.clear();
+    next_ = 0;
+    capacity_ = 0;
+
+    if (!options.enabled || options.capacity == 0) {
+        thresholdUs_.store(UINT64_MAX, std::memory_order_relaxed);
+        LOG(INFO) << "Slow request log disabled";
+        return;
+    }
+
+    ring_.reserve(options.capacity);
+    capacity_ = options.capacity;
+    thresholdUs_.store(
+        std::chrono::duration_cast<std::chrono::microseconds>(options.threshold).count(),
+        std::memory_order_relaxed);
+    LOG(INFO) << "Keeping the last " << options.capacity << " requests slower than "
+              << options.threshold.count() << "ms";
+}
+
+void SlowRequestLog::record(const SlowRequest& request) {
+    recorded_.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0) {
+        return;
+    }
+    if (ring_.size() < capacity_) {
+        ring_.push_back(request);
+    } else {
+        ring_[next_] = request;
+    }
+    next_ = (next_ + 1) % capacity_;
+}
+
+std::vector<SlowRequest> SlowRequestLog::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<SlowRequest> requests;
+    requests.reserve(ring_.size());
+    for (size_t i = 0; i < ring_.size(); i++) {
+        requests.push_back(ring_[(next_ + ring_.size() - 1 - i) % ring_.size()]);
+    }
+    return requests;
+}
+
+std::chrono::milliseconds SlowRequestLog::threshold() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::microseconds(thresholdUs_.load(std::memory_order_relaxed)));
+}
+
+} // namespace util
+} // namespace securapp
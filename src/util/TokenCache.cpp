@@ -0,0 +1,102 @@
+#include "util/TokenCache.h"
+#include "util/Metrics.h"
+#include <algorithm>
+#include <functional>
+
+namespace securapp {
+namespace util {
+
+TokenCacheOptions TokenCacheOptions::fromConfig(const json& cacheConfig) {
+    TokenCacheOptions options;
+    options.maxEntries = cacheConfig.value("max_entries", options.maxEntries);
+    options.ttl = std::chrono::milliseconds(cacheConfig.value("ttl_ms", options.ttl.count()));
+    options.negativeTtl = std::chrono::milliseconds(
+        cacheConfig.value("negative_ttl_ms", options.negativeTtl.count()));
+    return options;
+}
+
+TokenCache::TokenCache(const TokenCacheOptions& options) : options_(options) {
+    size_t shardCapacity = std::max<size_t>(options_.maxEntries / kShards, 1);
+    for (auto& shard : shards_) {
+        shard = std::make_unique<Shard>(shardCapacity);
+    }
+
+    auto& metrics = Metrics::getInstance();
+    hitCounter_ = metrics.counter("token_cache_hits_total", "",
+        "Token checks answered from the cache");
+    missCounter_ = metrics.counter("token_cache_misses_total", "",
+        "Token checks that had to ask the database");
+}
+
+std::optional<TokenInfo> TokenCache::lookup(std::string_view token) {
+    uint64_t hash = std::hash<std::string_view>()(token);
+    Shard& shard = shardFor(hash);
+    auto now = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Entry* entry = shard.entries.find(hash);
+        if (entry && entry->token == token && entry->until > now) {
+            TokenInfo info = entry->info;
+            Metrics::getInstance().add(hitCounter_);
+            return info;
+        }
+    }
+
+    Metrics::getInstance().add(missCounter_);
+    return std::nullopt;
+}
+
+void TokenCache::storeValid(std::string_view token, int64_t userId,
+                            std::chrono::system_clock::time_point expiresAt) {
+    // Trusted for the TTL, and never past the token's own expiry
+    auto now = std::chrono::steady_clock::now();
+    auto remaining = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        expiresAt - std::chrono::system_clock::now());
+    auto until = now + std::min<std::chrono::steady_clock::duration>(options_.ttl, remaining);
+
+    TokenInfo info;
+    info.valid = true;
+    info.userId = userId;
+    info.expiresAt = expiresAt;
+    store(token, info, until);
+}
+
+void TokenCache::storeInvalid(std::string_view token) {
+    store(token, TokenInfo(), std::chrono::steady_clock::now() + options_.negativeTtl);
+}
+
+void TokenCache::storeRevoked(std::string_view token,
+                              std::chrono::system_clock::time_point expiresAt) {
+    auto remaining = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        expiresAt - std::chrono::system_clock::now());
+    auto until = std::chrono::steady_clock::now() +
+        std::max<std::chrono::steady_clock::duration>(options_.negativeTtl, remaining);
+    store(token, TokenInfo(), until);
+}
+
+size_t TokenCache::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->entries.size();
+    }
+    return total;
+}
+
+void TokenCache::store(std::string_view token, const TokenInfo& info,
+                       std::chrono::steady_clock::time_point until) {
+    uint64_t hash = std::hash<std::string_view>()(token);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // A colliding token simply takes the slot over
+    bool inserted;
+    Entry& entry = shard.entries.findOrInsert(hash, inserted);
+    entry.token.assign(token.data(), token.size());
+    entry.info = info;
+    entry.until = until;
+}
+
+} // namespace util
+} // namespace securapp